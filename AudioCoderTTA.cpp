@@ -19,6 +19,7 @@ If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 
 #include <nsv/enc_if.h>
@@ -26,18 +27,47 @@ If not, see <https://www.gnu.org/licenses/>.
 #include <libtta.h>
 
 #include "AudioCoderTTA.h"
+#include "TTAContainer.h"
+#include "TraceRecorder.h"
 #include <tta_encoder_extend.h>
 
 TTAint32 CALLBACK write_callback(TTA_io_callback* io, TTAuint8* buffer, TTAuint32 size)
 {
 	TTA_io_callback_wrapper* iocb = reinterpret_cast<TTA_io_callback_wrapper*>(io);
+	TTAuint32 discarded = 0;
 
-	if (iocb->remain_data_buffer.data_length > iocb->remain_data_buffer.current_end_pos + size)
+	if (iocb->discard_length > 0)
+	{
+		discarded = static_cast<TTAuint32>(min(static_cast<size_t>(size), iocb->discard_length));
+		iocb->discard_length -= discarded;
+		buffer += discarded;
+		size -= discarded;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (iocb->direct_file != nullptr)
+	{
+		DWORD dwBytesWritten = 0;
+		if (!WriteFile(iocb->direct_file, buffer, size, &dwBytesWritten, nullptr) || dwBytesWritten != size)
+		{
+			iocb->direct_error = true;
+			return 0;
+		}
+		else
+		{
+			iocb->direct_length += size;
+			return static_cast<TTAint32>(discarded + size);
+		}
+	}
+	else if (iocb->remain_data_buffer.data_length > iocb->remain_data_buffer.current_end_pos + size)
 	{
 		memcpy_s(iocb->remain_data_buffer.buffer + iocb->remain_data_buffer.current_end_pos,
 			iocb->remain_data_buffer.data_length - iocb->remain_data_buffer.current_end_pos, buffer, size);
 		iocb->remain_data_buffer.current_end_pos += size;
-		return static_cast<TTAint32>(size);
+		return static_cast<TTAint32>(discarded + size);
 	}
 	else
 	{
@@ -63,11 +93,11 @@ TTAint64 CALLBACK seek_callback(TTA_io_callback* io, TTAint64 offset) {
 
 AudioCoderTTA::AudioCoderTTA() : AudioCoder()
 {
+	BufferAllocator::Attach();
 }
 
 AudioCoderTTA::AudioCoderTTA(int nch, int srate, int bps) : AudioCoder()
 {
-
 	m_iocb_wrapper.remain_data_buffer.buffer = nullptr;
 	m_iocb_wrapper.remain_data_buffer.data_length = 0;
 	m_iocb_wrapper.remain_data_buffer.current_pos = 0;
@@ -111,7 +141,7 @@ AudioCoderTTA::AudioCoderTTA(int nch, int srate, int bps) : AudioCoder()
 	m_iocb_wrapper.remain_data_buffer.data_length = (size_t)(PCM_BUFFER_LENGTH * m_smp_size + 4); // +4 for READ_BUFFER macro
 
 	// allocate memory for PCM buffer
-	m_iocb_wrapper.remain_data_buffer.buffer = static_cast<TTAuint8*>(_aligned_malloc(m_iocb_wrapper.remain_data_buffer.data_length, 16)); 
+	m_iocb_wrapper.remain_data_buffer.buffer = static_cast<TTAuint8*>(BufferAllocator::Allocate(m_iocb_wrapper.remain_data_buffer.data_length, 16));
 	if (m_iocb_wrapper.remain_data_buffer.buffer == nullptr)
 	{
 		throw AudioCoderTTA_exception(TTA_MEMORY_ERROR);
@@ -144,13 +174,55 @@ AudioCoderTTA::AudioCoderTTA(int nch, int srate, int bps) : AudioCoder()
 		}
 	}
 	m_TTA->init_set_info_for_memory(&m_info, 0);
+
+	// a constructor that throws never reaches the destructor, so the coder only
+	// counts as a pool client once nothing above can fail
+	BufferAllocator::Attach();
+}
+
+void *AudioCoderTTA::operator new(size_t size)
+{
+	void *p = BufferAllocator::Allocate(size, 16);
+	if (p == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	else
+	{
+		// Do nothing
+	}
+	return p;
+}
+
+void *AudioCoderTTA::operator new(size_t size, std::align_val_t alignment)
+{
+	void *p = BufferAllocator::Allocate(size, static_cast<size_t>(alignment));
+	if (p == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	else
+	{
+		// Do nothing
+	}
+	return p;
+}
+
+void AudioCoderTTA::operator delete(void *p)
+{
+	BufferAllocator::Free(p);
+}
+
+void AudioCoderTTA::operator delete(void *p, std::align_val_t alignment)
+{
+	BufferAllocator::Free(p);
 }
 
 void AudioCoderTTA::data_buf_free(data_buf *databuf)
 {
 	if (databuf->buffer != nullptr)
 	{
-		_aligned_free(databuf->buffer);
+		BufferAllocator::Free(databuf->buffer);
 		databuf->buffer = nullptr;
 	}
 	else
@@ -169,6 +241,7 @@ __forceinline int AudioCoderTTA::write_output(TTAuint8 *out, int out_avail, int
 
 	if (m_iocb_wrapper.remain_data_buffer.current_pos < m_iocb_wrapper.remain_data_buffer.current_end_pos) // write any header
 	{
+		TraceScope trace("write_output");
 		int l = min(out_avail - out_used_total, static_cast<int>(m_iocb_wrapper.remain_data_buffer.current_end_pos - m_iocb_wrapper.remain_data_buffer.current_pos));
 		memcpy_s(out + out_used_total, static_cast<rsize_t>(out_avail - out_used_total), m_iocb_wrapper.remain_data_buffer.buffer + m_iocb_wrapper.remain_data_buffer.current_pos, static_cast<rsize_t>(l));
 		out_used += l;
@@ -195,6 +268,9 @@ int AudioCoderTTA::Encode(int framepos, void *in0, int in_avail, int *in_used, v
 	*in_used = 0;
 	TTAuint8 * in = static_cast<TTAuint8*>(in0);
 	TTAuint8 * out = static_cast<TTAuint8*>(out0);
+	TraceScope trace("Encode");
+	GovernedPriorityScope priority(&m_governor);
+	LONGLONG call_begin = (m_call_recorder != nullptr) ? EncodeCallRecorder::Now() : 0;
 
 	for (;;)
 	{
@@ -211,13 +287,35 @@ int AudioCoderTTA::Encode(int framepos, void *in0, int in_avail, int *in_used, v
 				// Do nothing
 			}
 		}
+		else if (m_append_pcm_pos < m_append_pcm.size()) // re-encode the last frame of an appended file first
+		{
+			int l = min(static_cast<int>(m_buffer_size), static_cast<int>(m_append_pcm.size() - m_append_pcm_pos));
+			m_samplecount += l / m_smp_size;
+			TraceScope trace_block("process_stream");
+			m_governor.BeginWork();
+			m_TTA->process_stream(m_append_pcm.data() + m_append_pcm_pos, static_cast<TTAuint32>(l));
+			m_governor.EndWork();
+			m_append_pcm_pos += l;
+		}
 		else // encode more
 		{
 			int l = min(static_cast<int>(m_buffer_size), in_avail - *in_used);
 			if (l > 0 || (m_lastblock == 1 && in_avail == *in_used))
 			{
 				m_samplecount += l / m_smp_size;
+				TraceScope trace_block("process_stream");
+				m_governor.BeginWork();
 				m_TTA->process_stream(in + *in_used, static_cast<TTAuint32>(l));
+				m_governor.EndWork();
+				if (m_cache != nullptr)
+				{
+					m_pcm_hash.Update(in + *in_used, static_cast<size_t>(l));
+				}
+				else
+				{
+					// Do nothing
+				}
+				trace_block.End();
 				*in_used += l;
 
 				if (m_lastblock)
@@ -236,6 +334,15 @@ int AudioCoderTTA::Encode(int framepos, void *in0, int in_avail, int *in_used, v
 			}
 		}
 	}
+
+	if (m_call_recorder != nullptr)
+	{
+		m_call_recorder->Record(call_begin, in_avail, out_avail, *in_used, out_used_total);
+	}
+	else
+	{
+		// Do nothing
+	}
 	return out_used_total;
 }
 
@@ -262,184 +369,1033 @@ AudioCoderTTA::~AudioCoderTTA()
 		// Do nothing
 	}
 
+	BufferAllocator::Detach();
 } // ~AudioCoderTTA
 
 void AudioCoderTTA::PrepareToFinish()
 {
 	m_lastblock = 1;
+	if (m_call_recorder != nullptr)
+	{
+		m_call_recorder->MarkLast();
+	}
+	else
+	{
+		// Do nothing
+	}
 }
 
-void AudioCoderTTA::FinishAudio(const wchar_t *filename)
+void AudioCoderTTA::SetEncodeCache(const wchar_t *directory, TTAuint64 limit)
 {
-	m_info.samples = m_samplecount;
+	if (m_samplecount != 0)
+	{
+		throw AudioCoderTTA_exception(TTA_NOT_SUPPORTED);
+	}
+	else
+	{
+		// Do nothing
+	}
 
-	std::wstring lpTempPathBuffer;
-	wchar_t szTempFileName[MAX_PATHLEN];
+	m_cache = std::make_unique<EncodeCache>(directory, limit);
+	m_pcm_hash.Reset();
+}
 
-	DWORD dwBytesWritten = 0;
-	DWORD dwBytesRead = 0;
-	const size_t BUFSIZE = 65536;
-	TTAuint8 *chBuffer;
-	chBuffer = new TTAuint8[BUFSIZE];
+std::wstring AudioCoderTTA::make_cache_key(TTAuint64 pcm_hash) const
+{
+	std::vector<TTAuint8> apev2;
+	PcmHasher tag_hash;
 
-	memset(chBuffer, 0, BUFSIZE);
+	tta_build_apev2(&m_tags, &apev2);
+	tag_hash.Update(apev2.data(), apev2.size());
+	return EncodeCache::MakeKey(pcm_hash, &m_info, apev2.empty() ? 0 : tag_hash.Digest());
+}
 
-	if (wcsnlen(filename, MAX_PATHLEN) > MAX_PATH)
+// appended files depend on what was there before, so they are never looked up
+bool AudioCoderTTA::FetchCachedFile(TTAuint64 pcm_hash, TTAuint64 samples, const wchar_t *filename)
+{
+	TTA_info info = m_info;
+	std::vector<TTAuint8> id3v2;
+	std::vector<TTAuint8> apev2;
+
+	if (m_samplecount != 0)
 	{
-		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
-		return;
+		throw AudioCoderTTA_exception(TTA_NOT_SUPPORTED);
+	}
+	else if (m_cache == nullptr || m_append)
+	{
+		return false;
 	}
 	else
 	{
 		// Do nothing
 	}
 
-	std::wstring temppath = std::wstring(filename);
-	size_t lastposofpath;
-	lastposofpath = temppath.rfind(L'\\');
+	info.samples = static_cast<TTAuint32>(samples);
+	tta_build_id3v2(&m_tags, static_cast<size_t>(m_append_reserve) * 4, &id3v2);
+	tta_build_apev2(&m_tags, &apev2);
 
-	if (lastposofpath != std::string::npos)
+	TraceScope trace_cache("FetchCachedFile");
+	return m_cache->Fetch(make_cache_key(pcm_hash), &info, id3v2.size(), apev2.size(), filename);
+}
+
+void AudioCoderTTA::StartCallRecording(const wchar_t *filename)
+{
+	m_call_recorder = std::make_unique<EncodeCallRecorder>(filename, &m_info);
+}
+
+void AudioCoderTTA::OpenForAppend(const wchar_t *filename)
+{
+	tta_file_layout layout;
+	LARGE_INTEGER file_size;
+
+	if (m_TTA == nullptr || m_samplecount != 0 || m_append)
 	{
-		lpTempPathBuffer = temppath.substr(0, lastposofpath).c_str();
+		throw AudioCoderTTA_exception(TTA_NOT_SUPPORTED);
 	}
 	else
 	{
-		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
-		return;
+		// Do nothing
 	}
 
-	UINT uRetVal = GetTempFileNameW(lpTempPathBuffer.c_str(), // directory for tmp files
-		L"enc",     // temp file name prefix 
-		0,                // create unique name 
-		szTempFileName);  // buffer for name 
+	// the file is only read here; FinishAudio() rewrites it once the new frames are complete
+	HANDLE hFile = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
 
-	if (uRetVal == 0)
+	if (hFile == INVALID_HANDLE_VALUE)
 	{
-		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
-		return;
+		throw AudioCoderTTA_exception(TTA_OPEN_ERROR);
 	}
 	else
 	{
 		// Do nothing
 	}
 
-	HANDLE hFile = INVALID_HANDLE_VALUE;
-	HANDLE hTempFile = INVALID_HANDLE_VALUE;
+	try
+	{
+		tta_read_layout(hFile, &layout);
 
-	hFile = CreateFileW(filename,               // file name 
-		GENERIC_READ,         // open for reading 
-		0,                     // do not share 
-		nullptr,				   // default security 
-		OPEN_EXISTING,         // existing file only 
-		FILE_ATTRIBUTE_NORMAL, // normal file 
-		nullptr);                 // no template 
+		if ((layout.info.format != TTA_FORMAT_SIMPLE) ||
+			(layout.info.nch != m_info.nch) ||
+			(layout.info.bps != m_info.bps) ||
+			(layout.info.sps != m_info.sps))
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+		else if (!GetFileSizeEx(hFile, &file_size) ||
+			static_cast<TTAuint64>(file_size.QuadPart) < layout.data_offset + layout.data_length)
+		{
+			throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
 
-	if (hFile == INVALID_HANDLE_VALUE)
+		size_t frames = layout.seek_table.size();
+		TTAuint32 partial = layout.info.samples % layout.flen_std;
+		m_append_samples = layout.info.samples;
+
+		// A short last frame cannot be followed by further frames, so it is decoded
+		// here and encoded again at the head of the appended stream.
+		if (partial != 0)
+		{
+			frames--;
+			std::vector<TTAuint8> frame(layout.seek_table[frames]);
+			tta_read_file(hFile, tta_frame_offset(&layout, frames), frame.data(), static_cast<DWORD>(frame.size()));
+
+			m_append_pcm.resize(static_cast<size_t>(partial) * m_smp_size);
+			int decoded = tta_decode_frame(&layout.info, static_cast<TTAuint32>(frames), frame.data(), static_cast<TTAuint32>(frame.size()),
+				m_append_pcm.data(), static_cast<TTAuint32>(m_append_pcm.size()));
+			if (decoded != static_cast<int>(partial))
+			{
+				throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+			m_append_samples -= partial;
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		m_append_frames = frames;
+	}
+	catch (AudioCoderTTA_exception&)
 	{
-		throw AudioCoderTTA_exception(TTA_READ_ERROR);
-		return;
+		CloseHandle(hFile);
+		m_append_pcm.clear();
+		m_append_samples = 0;
+		throw;
+	}
+
+	if (!CloseHandle(hFile))
+	{
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
 	}
 	else
 	{
 		// Do nothing
 	}
 
-	BOOL fSuccess = FALSE;
-
-	// Write header
-	hTempFile = CreateFileW(szTempFileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	m_append_header_offset = layout.header_offset;
+	m_append_data_offset = layout.data_offset;
+	m_append_table_frames = layout.seek_table.size();
+	m_append_keep_end = tta_frame_offset(&layout, m_append_frames);
+	m_append_tail_offset = layout.data_offset + layout.data_length;
+	m_append_end = static_cast<TTAuint64>(file_size.QuadPart);
+	m_append_pcm_pos = 0;
+	m_append = true;
+
+	// the file already has a header, so drop the one produced by the encoder
+	size_t buffered = m_iocb_wrapper.remain_data_buffer.current_end_pos - m_iocb_wrapper.remain_data_buffer.current_pos;
+	m_iocb_wrapper.discard_length = (m_TTA->getHeaderOffset() > buffered) ? static_cast<size_t>(m_TTA->getHeaderOffset()) - buffered : 0;
+	m_iocb_wrapper.remain_data_buffer.current_pos = 0;
+	m_iocb_wrapper.remain_data_buffer.current_end_pos = 0;
+}
 
-	m_TTA->init_set_info_for_memory(&m_info, 0);
-	m_TTA->flushFifo();
+// Streams the seek table produced by finalize() into hTempFile at its current
+// position, so that the staging buffer never has to hold it. This only bounds the
+// write: libtta still keeps one entry per frame until finalize(), and spilling
+// that array would have to be done inside libtta.
+void AudioCoderTTA::write_seek_table_direct(HANDLE hTempFile)
+{
+	m_iocb_wrapper.remain_data_buffer.current_pos = 0;
+	m_iocb_wrapper.remain_data_buffer.current_end_pos = 0;
+	m_iocb_wrapper.direct_file = hTempFile;
+	m_iocb_wrapper.direct_length = 0;
+	m_iocb_wrapper.direct_error = false;
 
-	fSuccess = WriteFile(hTempFile, (m_iocb_wrapper.remain_data_buffer.buffer + m_iocb_wrapper.remain_data_buffer.current_pos),
-		static_cast<DWORD>(m_TTA->getHeaderOffset()), &dwBytesWritten, nullptr);
+	m_TTA->finalize();
 
-	if (!fSuccess)
+	m_iocb_wrapper.direct_file = nullptr;
+	if (m_iocb_wrapper.direct_error || m_iocb_wrapper.direct_length < 4)
 	{
 		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
-		return;
 	}
 	else
 	{
 		// Do nothing
 	}
+}
 
-	// Write seek table
-	DWORD dwRetVal = SetFilePointer(hTempFile, static_cast<LONG>(m_TTA->getHeaderOffset()), nullptr, FILE_BEGIN);
-	m_iocb_wrapper.remain_data_buffer.current_pos = 0;
-	m_iocb_wrapper.remain_data_buffer.current_end_pos = 0;
+// Forward chunked copy; hSrc and hDst may be the same file as long as dst_offset <= src_offset.
+void AudioCoderTTA::copy_range(HANDLE hSrc, TTAuint64 src_offset, HANDLE hDst, TTAuint64 dst_offset, TTAuint64 length)
+{
+	const DWORD CHUNK_SIZE = 65536;
+	std::vector<TTAuint8> chunk(CHUNK_SIZE);
+	DWORD dwBytesRead = 0;
 
-	m_TTA->finalize();
+	for (TTAuint64 pos = 0; pos < length; pos += dwBytesRead)
+	{
+		dwBytesRead = static_cast<DWORD>(min(length - pos, static_cast<TTAuint64>(CHUNK_SIZE)));
+		tta_read_file(hSrc, src_offset + pos, chunk.data(), dwBytesRead);
+		m_governor.ThrottleIO(dwBytesRead);
+		tta_write_file(hDst, dst_offset + pos, chunk.data(), dwBytesRead);
+	}
+}
 
-	fSuccess = WriteFile(hTempFile, m_iocb_wrapper.remain_data_buffer.buffer + m_iocb_wrapper.remain_data_buffer.current_pos,
-		static_cast<DWORD>(m_iocb_wrapper.remain_data_buffer.current_end_pos - m_iocb_wrapper.remain_data_buffer.current_pos), &dwBytesWritten, nullptr);
+// Writes the header and the combined seek table of an appended file to hOut at
+// out_offset and returns the end of the table. The old entries are read from hFile;
+// out_offset never lies behind the old header, so hOut may be hFile itself.
+TTAuint64 AudioCoderTTA::write_append_table(HANDLE hFile, HANDLE hOut, TTAuint64 out_offset)
+{
+	const DWORD CHUNK_SIZE = 65536;
+	DWORD dwBytesRead = 0;
+	std::vector<TTAuint8> chunk(CHUNK_SIZE);
+	TTAuint8 header[TTA_HEADER_SIZE];
+	TTAuint32 crc = 0;
+
+	TTA_info info = m_info;
+	info.samples = m_append_samples + m_samplecount;
+	tta_write_header(header, &info);
+	tta_write_file(hOut, out_offset, header, TTA_HEADER_SIZE);
+
+	// seek table entries of the existing frames, copied in chunks
+	TTAuint64 table_offset = m_append_header_offset + TTA_HEADER_SIZE;
+	TTAuint64 table_length = static_cast<TTAuint64>(m_append_frames) * 4;
+	for (TTAuint64 pos = 0; pos < table_length; pos += dwBytesRead)
+	{
+		dwBytesRead = static_cast<DWORD>(min(table_length - pos, static_cast<TTAuint64>(CHUNK_SIZE)));
+		tta_read_file(hFile, table_offset + pos, chunk.data(), dwBytesRead);
+		crc = tta_crc32_update(crc, chunk.data(), dwBytesRead);
+		tta_write_file(hOut, out_offset + TTA_HEADER_SIZE + pos, chunk.data(), dwBytesRead);
+	}
 
-	if (!fSuccess)
+	// entries of the appended frames, written by finalize() with a CRC of their own
+	LARGE_INTEGER new_table_pos;
+	new_table_pos.QuadPart = static_cast<LONGLONG>(out_offset + TTA_HEADER_SIZE + table_length);
+	if (!SetFilePointerEx(hOut, new_table_pos, nullptr, FILE_BEGIN))
 	{
-		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
-		return;
+		throw AudioCoderTTA_exception(TTA_SEEK_ERROR);
 	}
 	else
 	{
 		// Do nothing
 	}
 
-	dwRetVal = SetFilePointer(hFile, static_cast<LONG>(m_TTA->getHeaderOffset()), nullptr, FILE_BEGIN);
+	m_TTA->init_set_info_for_memory(&m_info, 0);
+	m_TTA->flushFifo();
+	write_seek_table_direct(hOut);
 
-	do
+	// replace that CRC with one over the whole table
+	TTAuint64 new_length = m_iocb_wrapper.direct_length - 4;
+	for (TTAuint64 pos = 0; pos < new_length; pos += dwBytesRead)
 	{
-		if (ReadFile(hFile, chBuffer, BUFSIZE, &dwBytesRead, nullptr))
-		{
-			fSuccess = WriteFile(hTempFile, chBuffer, dwBytesRead, &dwBytesWritten, nullptr);
-			if (!fSuccess)
-			{
-				data_buf_free(&m_iocb_wrapper.remain_data_buffer);
-				throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
-				return;
-			}
-			else
-			{
-				// Do nothing
-			}
-		}
-		else
-		{
-			data_buf_free(&m_iocb_wrapper.remain_data_buffer);
-			throw AudioCoderTTA_exception(TTA_READ_ERROR);
-			return;
-		}
-		//  Continues until the whole file is processed.
-	} while (dwBytesRead == BUFSIZE);
+		dwBytesRead = static_cast<DWORD>(min(new_length - pos, static_cast<TTAuint64>(CHUNK_SIZE)));
+		tta_read_file(hOut, static_cast<TTAuint64>(new_table_pos.QuadPart) + pos, chunk.data(), dwBytesRead);
+		crc = tta_crc32_update(crc, chunk.data(), dwBytesRead);
+	}
 
-	if (!CloseHandle(hFile))
+	for (int i = 0; i < 4; i++)
 	{
-		data_buf_free(&m_iocb_wrapper.remain_data_buffer);
-		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
-		return;
+		header[i] = static_cast<TTAuint8>(crc >> (i * 8));
+	}
+	tta_write_file(hOut, static_cast<TTAuint64>(new_table_pos.QuadPart) + new_length, header, 4);
+
+	return static_cast<TTAuint64>(new_table_pos.QuadPart) + new_length + 4;
+}
+
+// Completes an append started by OpenForAppend(). The new frames sit at the end of
+// the file behind the old ones. When the seek table keeps its size, or grows into
+// the padding of a leading ID3v2 tag, only the header and the table are rewritten and
+// the new frames are moved over the re-encoded last frame. Otherwise every frame has
+// to shift and the file is rebuilt next to the original and then swapped in; the
+// rebuilt file gets ID3v2 padding for at least as many entries again, so that the
+// following appends fit in place.
+// The in-place path is not atomic: moving the new frames overwrites the old short
+// frame and any trailing tag before the header and the table are rewritten, so a
+// failure in between leaves the file damaged. The rebuild path never touches the
+// original until the finished file replaces it.
+void AudioCoderTTA::finish_append(const wchar_t *filename)
+{
+	if (static_cast<TTAuint64>(m_append_samples) + m_samplecount > MAX_SAMPLES)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
 	}
 	else
 	{
 		// Do nothing
 	}
 
-	if (!CloseHandle(hTempFile))
+	HANDLE hFile = CreateFileW(filename, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	HANDLE hTempFile = INVALID_HANDLE_VALUE;
+	wchar_t szTempFileName[MAX_PATHLEN] = {};
+
+	if (hFile == INVALID_HANDLE_VALUE)
 	{
-		data_buf_free(&m_iocb_wrapper.remain_data_buffer);
-		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
-		return;
+		throw AudioCoderTTA_exception(TTA_OPEN_ERROR);
 	}
 	else
 	{
 		// Do nothing
 	}
 
-	CopyFileW(szTempFileName, filename, FALSE);
-	DeleteFileW(szTempFileName);
+	try
+	{
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(hFile, &file_size) || static_cast<TTAuint64>(file_size.QuadPart) < m_append_end)
+		{
+			throw AudioCoderTTA_exception(TTA_READ_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+		TTAuint64 appended = static_cast<TTAuint64>(file_size.QuadPart) - m_append_end;
 
-	data_buf_free(&m_iocb_wrapper.remain_data_buffer);
-	delete[] chBuffer;
-	chBuffer = nullptr;
+		// ID3v1/APEv2 tags behind the old frames go behind the new ones, unless new tags replace them
+		std::vector<TTAuint8> trailer(static_cast<size_t>(m_append_end - m_append_tail_offset));
+		if (!m_tags.empty())
+		{
+			tta_build_apev2(&m_tags, &trailer);
+		}
+		else if (!trailer.empty())
+		{
+			tta_read_file(hFile, m_append_tail_offset, trailer.data(), static_cast<DWORD>(trailer.size()));
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		TTAuint64 old_table = static_cast<TTAuint64>(m_append_table_frames) * 4 + 4;
+		TTAuint64 new_table = (static_cast<TTAuint64>(m_append_frames) + tta_frame_count(m_samplecount, m_info.sps)) * 4 + 4;
+
+		TTAuint64 old_padding = 0;
+		bool padding_known = tta_id3v2_padding(hFile, m_append_header_offset, &old_padding);
+
+		if (m_tags.empty() && new_table >= old_table &&
+			(new_table == old_table || (padding_known && new_table - old_table <= old_padding)))
+		{
+			TraceScope trace_append("FinishAudio.append_in_place");
+			TTAuint64 growth = new_table - old_table;
+			TTAuint64 end = m_append_keep_end + appended;
+
+			if (m_append_keep_end != m_append_end)
+			{
+				copy_range(hFile, m_append_end, hFile, m_append_keep_end, appended);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			if (!trailer.empty())
+			{
+				tta_write_file(hFile, end, trailer.data(), static_cast<DWORD>(trailer.size()));
+				end += trailer.size();
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			LARGE_INTEGER end_pos;
+			end_pos.QuadPart = static_cast<LONGLONG>(end);
+			if (!SetFilePointerEx(hFile, end_pos, nullptr, FILE_BEGIN) || !SetEndOfFile(hFile))
+			{
+				throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			if (growth != 0)
+			{
+				tta_id3v2_resize(hFile, m_append_header_offset - growth);
+			}
+			else
+			{
+				// Do nothing
+			}
+			write_append_table(hFile, hFile, m_append_header_offset - growth);
+		}
+		else
+		{
+			TraceScope trace_append("FinishAudio.append_rewrite");
+			std::wstring directory(filename);
+			size_t lastposofpath = directory.rfind(L'\\');
+
+			if (lastposofpath == std::wstring::npos ||
+				GetTempFileNameW(directory.substr(0, lastposofpath).c_str(), L"enc", 0, szTempFileName) == 0)
+			{
+				throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			hTempFile = CreateFileW(szTempFileName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (hTempFile == INVALID_HANDLE_VALUE)
+			{
+				throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			// Keep a leading ID3v2 tag unless new tags replace it, and leave padding for
+			// the seek table to grow into: the requested reserve, or as many entries
+			// again, so that rebuilds become rarer as the file grows.
+			TTAuint64 reserve = max(static_cast<TTAuint64>(m_append_reserve), new_table / 4) * 4;
+			TTAuint64 pos = m_append_header_offset;
+			std::vector<TTAuint8> id3v2;
+			if (!m_tags.empty() || m_append_header_offset == 0)
+			{
+				tta_build_id3v2(&m_tags, static_cast<size_t>(reserve), &id3v2);
+				tta_write_file(hTempFile, 0, id3v2.data(), static_cast<DWORD>(id3v2.size()));
+				pos = id3v2.size();
+			}
+			else if (padding_known)
+			{
+				// the frames of the old tag with new padding
+				pos = m_append_header_offset - old_padding;
+				copy_range(hFile, 0, hTempFile, 0, pos);
+				id3v2.resize(static_cast<size_t>(reserve), 0);
+				tta_write_file(hTempFile, pos, id3v2.data(), static_cast<DWORD>(id3v2.size()));
+				pos += reserve;
+				tta_id3v2_resize(hTempFile, pos);
+			}
+			else
+			{
+				// a tag that cannot be walked is kept as it is
+				copy_range(hFile, 0, hTempFile, 0, m_append_header_offset);
+			}
+
+			pos = write_append_table(hFile, hTempFile, pos);
+			copy_range(hFile, m_append_data_offset, hTempFile, pos, m_append_keep_end - m_append_data_offset);
+			pos += m_append_keep_end - m_append_data_offset;
+			copy_range(hFile, m_append_end, hTempFile, pos, appended);
+			pos += appended;
+			if (!trailer.empty())
+			{
+				tta_write_file(hTempFile, pos, trailer.data(), static_cast<DWORD>(trailer.size()));
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			if (!CloseHandle(hTempFile))
+			{
+				hTempFile = INVALID_HANDLE_VALUE;
+				throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+			}
+			else
+			{
+				hTempFile = INVALID_HANDLE_VALUE;
+			}
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		if (hTempFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(hTempFile);
+		}
+		else
+		{
+			// Do nothing
+		}
+		if (szTempFileName[0] != L'\0')
+		{
+			DeleteFileW(szTempFileName);
+		}
+		else
+		{
+			// Do nothing
+		}
+		throw;
+	}
+
+	if (!CloseHandle(hFile))
+	{
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	// the original stays untouched until the rebuilt file replaces it in one step
+	if (szTempFileName[0] != L'\0' && !MoveFileExW(szTempFileName, filename, MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(szTempFileName);
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void AudioCoderTTA::ReserveAppendFrames(TTAuint32 frames)
+{
+	m_append_reserve = frames;
+}
+
+void AudioCoderTTA::SetResourceLimits(int cpu_share, ULONGLONG io_bytes_per_second)
+{
+	m_governor.Configure(cpu_share, io_bytes_per_second);
+}
+
+struct governed_copy_state
+{
+	ResourceGovernor *governor;
+	LONGLONG transferred;
+};
+
+// paces the final CopyFileExW() with the I/O budget
+static DWORD CALLBACK governed_copy_progress(LARGE_INTEGER TotalFileSize, LARGE_INTEGER TotalBytesTransferred,
+	LARGE_INTEGER StreamSize, LARGE_INTEGER StreamBytesTransferred, DWORD dwStreamNumber, DWORD dwCallbackReason,
+	HANDLE hSourceFile, HANDLE hDestinationFile, LPVOID lpData)
+{
+	governed_copy_state *state = static_cast<governed_copy_state*>(lpData);
+
+	state->governor->ThrottleIO(static_cast<DWORD>(TotalBytesTransferred.QuadPart - state->transferred));
+	state->transferred = TotalBytesTransferred.QuadPart;
+	return PROGRESS_CONTINUE;
+}
+
+void AudioCoderTTA::FinishAudio(const wchar_t *filename)
+{
+	m_info.samples = m_samplecount;
+	GovernedPriorityScope priority(&m_governor);
+
+	// appended files depend on what was there before, so they are never stored
+	if (m_append)
+	{
+		finish_append(filename);
+		data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	std::wstring cache_key;
+	if (m_cache != nullptr)
+	{
+		cache_key = make_cache_key(m_pcm_hash.Digest());
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	std::wstring lpTempPathBuffer;
+	wchar_t szTempFileName[MAX_PATHLEN];
+
+	DWORD dwBytesWritten = 0;
+	DWORD dwBytesRead = 0;
+	const size_t BUFSIZE = 65536;
+	TTAuint8 *chBuffer;
+	chBuffer = new TTAuint8[BUFSIZE];
+
+	memset(chBuffer, 0, BUFSIZE);
+
+	if (wcsnlen(filename, MAX_PATHLEN) > MAX_PATH)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	std::wstring temppath = std::wstring(filename);
+	size_t lastposofpath;
+	lastposofpath = temppath.rfind(L'\\');
+
+	if (lastposofpath != std::string::npos)
+	{
+		lpTempPathBuffer = temppath.substr(0, lastposofpath).c_str();
+	}
+	else
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		return;
+	}
+
+	UINT uRetVal = GetTempFileNameW(lpTempPathBuffer.c_str(), // directory for tmp files
+		L"enc",     // temp file name prefix 
+		0,                // create unique name 
+		szTempFileName);  // buffer for name 
+
+	if (uRetVal == 0)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hTempFile = INVALID_HANDLE_VALUE;
+
+	hFile = CreateFileW(filename,               // file name 
+		GENERIC_READ,         // open for reading 
+		0,                     // do not share 
+		nullptr,				   // default security 
+		OPEN_EXISTING,         // existing file only 
+		FILE_ATTRIBUTE_NORMAL, // normal file 
+		nullptr);                 // no template 
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_READ_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	BOOL fSuccess = FALSE;
+	DWORD dwRetVal = 0;
+	LARGE_INTEGER copy_offset;
+	std::vector<TTAuint8> id3v2;
+	std::vector<TTAuint8> apev2;
+
+	tta_build_id3v2(&m_tags, static_cast<size_t>(m_append_reserve) * 4, &id3v2);
+	tta_build_apev2(&m_tags, &apev2);
+
+	// Write header
+	hTempFile = CreateFileW(szTempFileName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	TraceScope trace_header("FinishAudio.header");
+	m_TTA->init_set_info_for_memory(&m_info, 0);
+	m_TTA->flushFifo();
+
+	if (!id3v2.empty() && !WriteFile(hTempFile, id3v2.data(), static_cast<DWORD>(id3v2.size()), &dwBytesWritten, nullptr))
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	fSuccess = WriteFile(hTempFile, (m_iocb_wrapper.remain_data_buffer.buffer + m_iocb_wrapper.remain_data_buffer.current_pos),
+		static_cast<DWORD>(m_TTA->getHeaderOffset()), &dwBytesWritten, nullptr);
+
+	if (!fSuccess)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	trace_header.End();
+
+	// the seek table and the frames may fail after the temp file exists
+	try
+	{
+		// Write seek table
+		TraceScope trace_seek_table("FinishAudio.seek_table");
+		dwRetVal = SetFilePointer(hTempFile, static_cast<LONG>(id3v2.size() + m_TTA->getHeaderOffset()), nullptr, FILE_BEGIN);
+		write_seek_table_direct(hTempFile);
+
+		copy_offset.QuadPart = static_cast<LONGLONG>(m_TTA->getHeaderOffset());
+
+		if (!SetFilePointerEx(hFile, copy_offset, nullptr, FILE_BEGIN))
+		{
+			throw AudioCoderTTA_exception(TTA_SEEK_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		TraceScope trace_copy("FinishAudio.copy");
+		do
+		{
+			if (ReadFile(hFile, chBuffer, BUFSIZE, &dwBytesRead, nullptr))
+			{
+				m_governor.ThrottleIO(dwBytesRead);
+				fSuccess = WriteFile(hTempFile, chBuffer, dwBytesRead, &dwBytesWritten, nullptr);
+				if (!fSuccess)
+				{
+					data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+					throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+					return;
+				}
+				else
+				{
+					// Do nothing
+				}
+			}
+			else
+			{
+				data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+				throw AudioCoderTTA_exception(TTA_READ_ERROR);
+				return;
+			}
+			//  Continues until the whole file is processed.
+		} while (dwBytesRead == BUFSIZE);
+		trace_copy.End();
+
+		if (!apev2.empty() && !WriteFile(hTempFile, apev2.data(), static_cast<DWORD>(apev2.size()), &dwBytesWritten, nullptr))
+		{
+			data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+			throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+			return;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		CloseHandle(hTempFile);
+		DeleteFileW(szTempFileName);
+		delete[] chBuffer;
+		throw;
+	}
+
+	if (!CloseHandle(hFile))
+	{
+		data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (!CloseHandle(hTempFile))
+	{
+		data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	TraceScope trace_replace("FinishAudio.CopyFileW");
+	if (m_governor.IsEnabled())
+	{
+		governed_copy_state state = { &m_governor, 0 };
+		fSuccess = CopyFileExW(szTempFileName, filename, &governed_copy_progress, &state, nullptr, 0);
+	}
+	else
+	{
+		fSuccess = CopyFileW(szTempFileName, filename, FALSE);
+	}
+	DeleteFileW(szTempFileName);
+	trace_replace.End();
+
+	// filename does not hold the finished file, so it must not be cached
+	if (!fSuccess)
+	{
+		data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+		delete[] chBuffer;
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (!cache_key.empty())
+	{
+		TraceScope trace_cache("FinishAudio.cache_store");
+		m_cache->Store(cache_key, filename);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+	delete[] chBuffer;
+	chBuffer = nullptr;
+}
+
+void AudioCoderTTA::EncodeToMemory(void *in0, int in_avail, std::vector<TTAuint8> *out)
+{
+	TTAuint8 dummy = 0;
+	TTAuint8 *in = (in0 != nullptr) ? static_cast<TTAuint8*>(in0) : &dummy;
+	int in_used = 0;
+	size_t grow = m_iocb_wrapper.remain_data_buffer.data_length;
+
+	for (;;)
+	{
+		size_t length = out->size();
+		out->resize(length + grow);
+
+		int out_used = Encode(0, in, in_avail, &in_used, out->data() + length, static_cast<int>(grow));
+		out->resize(length + out_used);
+
+		in += in_used;
+		in_avail -= in_used;
+		if (out_used == 0 && in_avail == 0)
+		{
+			break;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+}
+
+size_t AudioCoderTTA::GetSeekTableSize() const
+{
+	return static_cast<size_t>(tta_frame_count(m_samplecount, m_info.sps)) * 4 + 4;
+}
+
+void AudioCoderTTA::SetTag(const char *key, const char *value)
+{
+	if (!tta_tag_key_valid(key))
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	for (auto it = m_tags.begin(); it != m_tags.end(); ++it)
+	{
+		if (!lstrcmpiA(it->key.c_str(), key))
+		{
+			m_tags.erase(it);
+			break;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+
+	if (value != nullptr && value[0] != '\0')
+	{
+		m_tags.push_back({ key, value });
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void AudioCoderTTA::ClearTags()
+{
+	m_tags.clear();
+}
+
+size_t AudioCoderTTA::GetTagSize() const
+{
+	return tta_tag_size(&m_tags);
+}
+
+// "tag.<key>" sets or, with empty data, removes a tag; "tag_clear" removes all of them
+int AudioCoderTTA::SetConfigItem(const char *item, const char *data)
+{
+	if (!_strnicmp(item, TAG_ITEM_PREFIX, TAG_ITEM_PREFIX_LENGTH))
+	{
+		if (!tta_tag_key_valid(item + TAG_ITEM_PREFIX_LENGTH))
+		{
+			return 0;
+		}
+		else
+		{
+			// Do nothing
+		}
+		SetTag(item + TAG_ITEM_PREFIX_LENGTH, data);
+		return 1;
+	}
+	else if (!lstrcmpiA(item, "tag_clear"))
+	{
+		ClearTags();
+		return 1;
+	}
+	else
+	{
+		// Do nothing
+	}
+	return 0;
+}
+
+size_t AudioCoderTTA::FinishAudio(TTAuint8 *data, size_t length, size_t capacity)
+{
+	std::vector<TTAuint8> id3v2;
+	std::vector<TTAuint8> apev2;
+
+	tta_build_id3v2(&m_tags, 0, &id3v2);
+	tta_build_apev2(&m_tags, &apev2);
+
+	// the last frame is only emitted by the Encode() call after PrepareToFinish()
+	if (m_append || m_lastblock != 2)
+	{
+		throw AudioCoderTTA_exception(TTA_NOT_SUPPORTED);
+	}
+	else if (length + GetSeekTableSize() + id3v2.size() + apev2.size() > capacity)
+	{
+		throw AudioCoderTTA_exception(TTA_MEMORY_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	m_info.samples = m_samplecount;
+
+	// header
+	TraceScope trace_header("FinishAudio.header");
+	m_TTA->init_set_info_for_memory(&m_info, 0);
+	m_TTA->flushFifo();
+
+	size_t header_size = static_cast<size_t>(m_TTA->getHeaderOffset());
+	if (length < header_size)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	trace_header.End();
+
+	// make room for the ID3v2 tag in front and the seek table between the header and the first frame
+	TraceScope trace_move("FinishAudio.move");
+	size_t table_size = GetSeekTableSize();
+	size_t prefix_size = id3v2.size() + header_size;
+	memmove(data + prefix_size + table_size, data + header_size, length - header_size);
+	if (!id3v2.empty())
+	{
+		memcpy_s(data, capacity, id3v2.data(), id3v2.size());
+	}
+	else
+	{
+		// Do nothing
+	}
+	memcpy_s(data + id3v2.size(), capacity - id3v2.size(),
+		m_iocb_wrapper.remain_data_buffer.buffer + m_iocb_wrapper.remain_data_buffer.current_pos, header_size);
+	trace_move.End();
+
+	// and let finalize() write it straight into that room
+	TraceScope trace_seek_table("FinishAudio.seek_table");
+	data_buf staging = m_iocb_wrapper.remain_data_buffer;
+	m_iocb_wrapper.remain_data_buffer.buffer = data + prefix_size;
+	m_iocb_wrapper.remain_data_buffer.data_length = table_size + 1; // write_callback keeps one byte spare
+	m_iocb_wrapper.remain_data_buffer.current_pos = 0;
+	m_iocb_wrapper.remain_data_buffer.current_end_pos = 0;
+
+	m_TTA->finalize();
+
+	size_t written = m_iocb_wrapper.remain_data_buffer.current_end_pos;
+	m_iocb_wrapper.remain_data_buffer = staging;
+	data_buf_free(&m_iocb_wrapper.remain_data_buffer);
+
+	if (written != table_size)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	length += id3v2.size() + table_size;
+	if (!apev2.empty())
+	{
+		memcpy_s(data + length, capacity - length, apev2.data(), apev2.size());
+	}
+	else
+	{
+		// Do nothing
+	}
+	return length + apev2.size();
+}
+
+void AudioCoderTTA::FinishAudio(std::vector<TTAuint8> *data)
+{
+	size_t length = data->size();
+
+	data->resize(length + GetSeekTableSize() + GetTagSize());
+	data->resize(FinishAudio(data->data(), length, data->size()));
 }
 
 void AudioCoderTTA::FinishAudio(const char *filename)
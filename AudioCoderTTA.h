@@ -28,12 +28,23 @@ If not, see <https://www.gnu.org/licenses/>.
 #include <windows.h>
 #include <stdexcept>
 #include <stdlib.h>
+#include <memory>
+#include <new>
+#include <vector>
 #include <libtta.h>
 
 #include <tta_encoder_extend.h>
 
+#include "BufferAllocator.h"
+#include "EncodeCache.h"
+#include "EncodeCallRecorder.h"
+#include "ResourceGovernor.h"
+#include "TTAContainer.h"
+
 static const int MAX_PATHLEN = 8192;
 static const int PCM_BUFFER_LENGTH = 5210;
+static const char TAG_ITEM_PREFIX[] = "tag.";
+static const int TAG_ITEM_PREFIX_LENGTH = 4;
 
 struct data_buf
 {
@@ -47,6 +58,10 @@ struct TTA_io_callback_wrapper
 {
 	TTA_io_callback iocb{};
 	data_buf remain_data_buffer{};
+	size_t discard_length{};	// bytes to drop before buffering (header of an appended stream)
+	HANDLE direct_file{};		// when set, output bypasses remain_data_buffer (seek table on finalization)
+	TTAuint64 direct_length{};
+	bool direct_error{};
 };
 
 /////////////////////// TTA encoder functions /////////////////////////
@@ -58,14 +73,60 @@ public:
 	int Encode(int framepos, void *in0, int in_avail, int *in_used, void *out0, int out_avail) override; //returns bytes in out
 	virtual ~AudioCoderTTA();
 
+	// instances follow the BufferAllocator policy, like their staging buffers
+	static void *operator new(size_t size);
+	static void *operator new(size_t size, std::align_val_t alignment);
+	static void operator delete(void *p);
+	static void operator delete(void *p, std::align_val_t alignment);
+
 	/* internal public functions */
 	void PrepareToFinish();
 	void FinishAudio(const wchar_t *filename);
 	void FinishAudio(const char *filename);
 
+	/* append mode: call before the first Encode(), then append Encode() output to the end of filename;
+	   the file is only read until FinishAudio() completes it */
+	void OpenForAppend(const wchar_t *filename);
+	// ID3v2 padding written by FinishAudio(filename) for the seek table entries of that many
+	// later frames, so that appending them only rewrites the header and the table
+	void ReserveAppendFrames(TTAuint32 frames);
+
+	/* governed mode: cpu_share in percent of one CPU (100 = unpaced), io in bytes per second (0 = unlimited);
+	   the budgets are shared by the coders of the process that set a limit, the others run unpaced */
+	void SetResourceLimits(int cpu_share, ULONGLONG io_bytes_per_second);
+
+	/* content-addressed cache of finished files, keyed by the PCM hash, format and tags;
+	   FinishAudio(filename) stores every file it finishes */
+	void SetEncodeCache(const wchar_t *directory, TTAuint64 limit);
+
+	/* before anything is encoded: replaces filename with the cached file for PCM with that hash
+	   and length, so the encode can be skipped; false on a miss */
+	bool FetchCachedFile(TTAuint64 pcm_hash, TTAuint64 samples, const wchar_t *filename);
+
+	/* logs every Encode() call for "tta_tool replay" */
+	void StartCallRecording(const wchar_t *filename);
+
+	/* tags written by FinishAudio(): ID3v2 in front of the header, APEv2 at the end */
+	void SetTag(const char *key, const char *value); // UTF-8; an empty value removes the key
+	void ClearTags();
+	int SetConfigItem(const char *item, const char *data); // "tag.<key>" and "tag_clear"; returns 0 for other items
+
+	/* in-memory target: data holds all Encode() output and is finalized in place;
+	   call PrepareToFinish() and then EncodeToMemory(nullptr, 0, out) before FinishAudio() */
+	void EncodeToMemory(void *in0, int in_avail, std::vector<TTAuint8> *out);
+	size_t GetSeekTableSize() const;
+	size_t GetTagSize() const;
+	size_t FinishAudio(TTAuint8 *data, size_t length, size_t capacity); // returns the final length
+	void FinishAudio(std::vector<TTAuint8> *data);
+
 protected:
 	__forceinline int write_output(TTAuint8* out, int out_avail, int out_used_total);
 	void data_buf_free(data_buf* databuf);
+	void copy_range(HANDLE hSrc, TTAuint64 src_offset, HANDLE hDst, TTAuint64 dst_offset, TTAuint64 length);
+	TTAuint64 write_append_table(HANDLE hFile, HANDLE hOut, TTAuint64 out_offset);
+	void finish_append(const wchar_t *filename);
+	void write_seek_table_direct(HANDLE hTempFile);
+	std::wstring make_cache_key(TTAuint64 pcm_hash) const;
 
 	TTA_info m_info = {};
 
@@ -73,6 +134,27 @@ protected:
 	TTAuint32 m_samplecount = 0;
 	int m_smp_size = 0;
 
+	// append mode
+	bool m_append = false;
+	TTAuint32 m_append_samples = 0;
+	TTAuint64 m_append_header_offset = 0;
+	TTAuint64 m_append_data_offset = 0;
+	size_t m_append_table_frames = 0;	// seek table entries of the file as opened
+	size_t m_append_frames = 0;			// frames kept as they are
+	TTAuint64 m_append_keep_end = 0;	// end of the last kept frame
+	TTAuint64 m_append_tail_offset = 0;	// end of all old frames, start of a trailing tag
+	TTAuint64 m_append_end = 0;			// old file size; new frames are appended from here
+	TTAuint32 m_append_reserve = 0;		// see ReserveAppendFrames()
+	std::vector<TTAuint8> m_append_pcm;
+	size_t m_append_pcm_pos = 0;
+
+	std::vector<tta_tag_item> m_tags;
+
+	ResourceGovernor m_governor;
+	std::unique_ptr<EncodeCallRecorder> m_call_recorder;
+	std::unique_ptr<EncodeCache> m_cache;
+	PcmHasher m_pcm_hash;
+
 private:
 	alignas(16) TTA_io_callback_wrapper m_iocb_wrapper ={};
 	alignas(tta::tta_encoder_extend) std::byte m_ttaenc_mem[sizeof(tta::tta_encoder_extend)] = {};
@@ -0,0 +1,410 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <malloc.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "BufferAllocator.h"
+
+static const size_t BLOCK_PREFIX_SIZE = 64;	// keeps blocks 64 byte aligned
+
+enum block_kind : DWORD
+{
+	BLOCK_HEAP,		// _aligned_malloc()
+	BLOCK_POOL,		// carved from a pool chunk
+	BLOCK_REGION,	// own VirtualAllocExNuma() region, larger than a chunk
+};
+
+struct pool_chunk
+{
+	BYTE *base;
+	size_t size;
+	size_t live;	// blocks handed out and not freed yet
+};
+
+// stored at the start of the prefix in front of every block
+struct block_header
+{
+	size_t size;		// including the prefix
+	DWORD pool;			// pool key, see pool_key()
+	block_kind kind;
+	pool_chunk *chunk;	// BLOCK_POOL only
+};
+
+struct buffer_pool
+{
+	pool_chunk *current = nullptr;
+	size_t remaining = 0;
+	std::vector<pool_chunk*> chunks;
+	std::map<size_t, std::vector<BYTE*>> free_blocks;	// by size
+};
+
+static std::mutex pool_lock;
+static std::map<DWORD, buffer_pool> pools;
+static size_t pool_clients = 0;	// see BufferAllocator::Attach()
+static std::once_flag large_pages_once;
+static std::atomic<bool> large_pages_usable{ false };
+
+static size_t round_up(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static DWORD pool_key(DWORD node, bool large)
+{
+	return (node << 1) | (large ? 1 : 0);
+}
+
+static DWORD current_node()
+{
+	PROCESSOR_NUMBER processor;
+	USHORT node = 0;
+
+	GetCurrentProcessorNumberEx(&processor);
+	if (GetNumaProcessorNodeEx(&processor, &node) && node != 0xFFFF)
+	{
+		return node;
+	}
+	else
+	{
+		return NUMA_NO_PREFERRED_NODE;
+	}
+}
+
+static bool enable_lock_memory_privilege()
+{
+	HANDLE hToken = nullptr;
+	TOKEN_PRIVILEGES privileges = {};
+	bool enabled = false;
+
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+	{
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (LookupPrivilegeValueW(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid))
+	{
+		// AdjustTokenPrivileges() succeeds without assigning anything when the account lacks the right
+		enabled = AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+	}
+	else
+	{
+		// Do nothing
+	}
+	CloseHandle(hToken);
+	return enabled;
+}
+
+static BYTE *virtual_alloc(size_t size, DWORD node, bool large)
+{
+	DWORD type = MEM_RESERVE | MEM_COMMIT | (large ? MEM_LARGE_PAGES : 0);
+	return static_cast<BYTE*>(VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, type, PAGE_READWRITE, node));
+}
+
+// Returns an unused chunk to the OS, large pages included; pool_lock must be held.
+static void release_chunk(buffer_pool *pool, pool_chunk *chunk)
+{
+	BYTE *end = chunk->base + chunk->size;
+
+	for (auto &blocks : pool->free_blocks)
+	{
+		blocks.second.erase(std::remove_if(blocks.second.begin(), blocks.second.end(),
+			[chunk, end](BYTE *block) { return block >= chunk->base && block < end; }), blocks.second.end());
+	}
+
+	if (pool->current == chunk)
+	{
+		pool->current = nullptr;
+		pool->remaining = 0;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	pool->chunks.erase(std::find(pool->chunks.begin(), pool->chunks.end(), chunk));
+	VirtualFree(chunk->base, 0, MEM_RELEASE);
+	delete chunk;
+}
+
+static BYTE *pool_alloc(size_t size, DWORD node, bool large)
+{
+	size_t page_size = large ? GetLargePageMinimum() : 0;
+	DWORD key = pool_key(node, large);
+	BYTE *base = nullptr;
+	block_kind kind = BLOCK_POOL;
+	pool_chunk *chunk = nullptr;
+
+	if (large && page_size == 0)
+	{
+		return nullptr;
+	}
+	else if (size > BUFFER_POOL_CHUNK_SIZE)
+	{
+		base = virtual_alloc(large ? round_up(size, page_size) : size, node, large);
+		kind = BLOCK_REGION;
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(pool_lock);
+		buffer_pool &pool = pools[key];
+		auto it = pool.free_blocks.find(size);
+
+		if (it != pool.free_blocks.end() && !it->second.empty())
+		{
+			base = it->second.back();
+			it->second.pop_back();
+			chunk = reinterpret_cast<block_header*>(base)->chunk;
+		}
+		else
+		{
+			if (pool.remaining < size)
+			{
+				// the tail of the old chunk is given up
+				size_t chunk_size = large ? round_up(BUFFER_POOL_CHUNK_SIZE, page_size) : BUFFER_POOL_CHUNK_SIZE;
+				BYTE *chunk_base = virtual_alloc(chunk_size, node, large);
+
+				pool.current = nullptr;
+				pool.remaining = 0;
+				if (chunk_base != nullptr)
+				{
+					pool.current = new pool_chunk{ chunk_base, chunk_size, 0 };
+					pool.remaining = chunk_size;
+					pool.chunks.push_back(pool.current);
+				}
+				else
+				{
+					// Do nothing
+				}
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			if (pool.current != nullptr)
+			{
+				chunk = pool.current;
+				base = chunk->base + (chunk->size - pool.remaining);
+				pool.remaining -= size;
+			}
+			else
+			{
+				// Do nothing
+			}
+		}
+
+		if (chunk != nullptr)
+		{
+			chunk->live++;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+
+	if (base != nullptr)
+	{
+		block_header *header = reinterpret_cast<block_header*>(base);
+		header->size = size;
+		header->pool = key;
+		header->kind = kind;
+		header->chunk = chunk;
+	}
+	else
+	{
+		// Do nothing
+	}
+	return base;
+}
+
+void BufferAllocator::SetPolicy(DWORD policy)
+{
+	// the privilege does not change while the process runs, so it is only asked for once
+	if (policy & BUFFER_POLICY_LARGE_PAGES)
+	{
+		std::call_once(large_pages_once, []()
+		{
+			large_pages_usable.store(GetLargePageMinimum() != 0 && enable_lock_memory_privilege());
+		});
+	}
+	else
+	{
+		// Do nothing
+	}
+	s_policy.store(policy, std::memory_order_relaxed);
+}
+
+void BufferAllocator::Attach()
+{
+	std::lock_guard<std::mutex> lock(pool_lock);
+	pool_clients++;
+}
+
+// the last client gives every chunk without live blocks back to the OS
+void BufferAllocator::Detach()
+{
+	std::lock_guard<std::mutex> lock(pool_lock);
+
+	pool_clients--;
+	if (pool_clients != 0)
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	for (auto &pool : pools)
+	{
+		std::vector<pool_chunk*> idle;
+		for (pool_chunk *chunk : pool.second.chunks)
+		{
+			if (chunk->live == 0)
+			{
+				idle.push_back(chunk);
+			}
+			else
+			{
+				// Do nothing
+			}
+		}
+
+		for (pool_chunk *chunk : idle)
+		{
+			release_chunk(&pool.second, chunk);
+		}
+	}
+}
+
+void *BufferAllocator::Allocate(size_t size, size_t alignment)
+{
+	DWORD policy = GetPolicy();
+	size_t total = round_up(size + BLOCK_PREFIX_SIZE, BLOCK_PREFIX_SIZE);
+	BYTE *base = nullptr;
+
+	if (alignment > BLOCK_PREFIX_SIZE)
+	{
+		return nullptr;
+	}
+	else if (policy != BUFFER_POLICY_DEFAULT)
+	{
+		DWORD node = (policy & BUFFER_POLICY_NUMA) ? current_node() : NUMA_NO_PREFERRED_NODE;
+
+		if ((policy & BUFFER_POLICY_LARGE_PAGES) && large_pages_usable.load(std::memory_order_relaxed))
+		{
+			base = pool_alloc(total, node, true);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		if (base == nullptr)
+		{
+			base = pool_alloc(total, node, false);
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (base == nullptr)
+	{
+		base = static_cast<BYTE*>(_aligned_malloc(total, BLOCK_PREFIX_SIZE));
+		if (base == nullptr)
+		{
+			return nullptr;
+		}
+		else
+		{
+			block_header *header = reinterpret_cast<block_header*>(base);
+			header->size = total;
+			header->pool = 0;
+			header->kind = BLOCK_HEAP;
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+	return base + BLOCK_PREFIX_SIZE;
+}
+
+void BufferAllocator::Free(void *block)
+{
+	if (block == nullptr)
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	BYTE *base = static_cast<BYTE*>(block) - BLOCK_PREFIX_SIZE;
+	block_header *header = reinterpret_cast<block_header*>(base);
+
+	switch (header->kind)
+	{
+	case BLOCK_POOL:
+	{
+		std::lock_guard<std::mutex> lock(pool_lock);
+		buffer_pool &pool = pools[header->pool];
+		pool_chunk *chunk = header->chunk;
+
+		pool.free_blocks[header->size].push_back(base);
+		chunk->live--;
+
+		// blocks that outlive the last client, such as the coder itself, release their chunk on the way out
+		if (pool_clients == 0 && chunk->live == 0)
+		{
+			release_chunk(&pool, chunk);
+		}
+		else
+		{
+			// Do nothing
+		}
+		break;
+	}
+	case BLOCK_REGION:
+		VirtualFree(base, 0, MEM_RELEASE);
+		break;
+	default:
+		_aligned_free(base);
+		break;
+	}
+}
@@ -0,0 +1,58 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUFFERALLOCATOR_H_INCLUDED
+#define BUFFERALLOCATOR_H_INCLUDED
+
+#include <windows.h>
+#include <atomic>
+
+static const DWORD BUFFER_POLICY_DEFAULT = 0;			// _aligned_malloc
+static const DWORD BUFFER_POLICY_NUMA = 0x1;			// memory of the calling thread's NUMA node
+static const DWORD BUFFER_POLICY_LARGE_PAGES = 0x2;	// large pages, needs SeLockMemoryPrivilege
+
+static const size_t BUFFER_POOL_CHUNK_SIZE = 2 * 1024 * 1024;
+
+///////////////////////// Encoder buffer allocator ////////////////////
+// Process-wide placement policy for encoder buffers. With a policy set,
+// blocks are carved from per-node chunks obtained with
+// VirtualAllocExNuma(), optionally as large pages; freed blocks are
+// kept for reuse by blocks of the same size while a client is attached.
+// Whatever the policy cannot provide falls back to the next weaker one
+// and finally to _aligned_malloc(), so Allocate() only fails when
+// memory is exhausted.
+class BufferAllocator
+{
+public:
+	static void SetPolicy(DWORD policy);
+	static DWORD GetPolicy() { return s_policy.load(std::memory_order_relaxed); }
+
+	static void *Allocate(size_t size, size_t alignment);	// alignment up to 64
+	static void Free(void *block);
+
+	// clients keep the pools alive; once the last one detaches, idle chunks are released
+	static void Attach();
+	static void Detach();
+
+private:
+	inline static std::atomic<DWORD> s_policy{ BUFFER_POLICY_DEFAULT };
+}; // class BufferAllocator
+
+#endif // #ifndef BUFFERALLOCATOR_H_INCLUDED
@@ -0,0 +1,435 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include "AudioCoderTTA.h"
+#include "EncodeCache.h"
+#include "TTAContainer.h"
+
+static const TTAuint64 XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const TTAuint64 XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const TTAuint64 XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const TTAuint64 XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const TTAuint64 XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static __forceinline TTAuint64 rotl64(TTAuint64 x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static __forceinline TTAuint64 read64(const TTAuint8 *p)
+{
+	TTAuint64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static __forceinline TTAuint32 read32(const TTAuint8 *p)
+{
+	TTAuint32 v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static __forceinline TTAuint64 xxh64_round(TTAuint64 acc, TTAuint64 input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static __forceinline TTAuint64 xxh64_merge_round(TTAuint64 acc, TTAuint64 val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+void PcmHasher::Reset()
+{
+	m_acc[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+	m_acc[1] = XXH_PRIME64_2;
+	m_acc[2] = 0;
+	m_acc[3] = 0 - XXH_PRIME64_1;
+	m_total = 0;
+	m_stripe_length = 0;
+}
+
+void PcmHasher::Update(const TTAuint8 *data, size_t length)
+{
+	m_total += length;
+
+	// complete a partial stripe first
+	if (m_stripe_length > 0)
+	{
+		size_t l = min(length, sizeof(m_stripe) - m_stripe_length);
+		memcpy(m_stripe + m_stripe_length, data, l);
+		m_stripe_length += l;
+		data += l;
+		length -= l;
+		if (m_stripe_length < sizeof(m_stripe))
+		{
+			return;
+		}
+		else
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				m_acc[i] = xxh64_round(m_acc[i], read64(m_stripe + i * 8));
+			}
+			m_stripe_length = 0;
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	for (; length >= 32; data += 32, length -= 32)
+	{
+		m_acc[0] = xxh64_round(m_acc[0], read64(data));
+		m_acc[1] = xxh64_round(m_acc[1], read64(data + 8));
+		m_acc[2] = xxh64_round(m_acc[2], read64(data + 16));
+		m_acc[3] = xxh64_round(m_acc[3], read64(data + 24));
+	}
+
+	memcpy(m_stripe, data, length);
+	m_stripe_length = length;
+}
+
+TTAuint64 PcmHasher::Digest() const
+{
+	TTAuint64 h;
+	const TTAuint8 *p = m_stripe;
+	size_t length = m_stripe_length;
+
+	if (m_total >= 32)
+	{
+		h = rotl64(m_acc[0], 1) + rotl64(m_acc[1], 7) + rotl64(m_acc[2], 12) + rotl64(m_acc[3], 18);
+		for (int i = 0; i < 4; i++)
+		{
+			h = xxh64_merge_round(h, m_acc[i]);
+		}
+	}
+	else
+	{
+		h = XXH_PRIME64_5;
+	}
+	h += m_total;
+
+	for (; length >= 8; p += 8, length -= 8)
+	{
+		h ^= xxh64_round(0, read64(p));
+		h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if (length >= 4)
+	{
+		h ^= static_cast<TTAuint64>(read32(p)) * XXH_PRIME64_1;
+		h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+		length -= 4;
+	}
+	else
+	{
+		// Do nothing
+	}
+	for (; length > 0; p++, length--)
+	{
+		h ^= *p * XXH_PRIME64_5;
+		h = rotl64(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+EncodeCache::EncodeCache(const wchar_t *directory, TTAuint64 limit) : m_directory(directory), m_limit(limit)
+{
+	if (!m_directory.empty() && m_directory.back() != L'\\' && m_directory.back() != L'/')
+	{
+		m_directory += L'\\';
+	}
+	else
+	{
+		// Do nothing
+	}
+	CreateDirectoryW(m_directory.c_str(), nullptr);
+}
+
+EncodeCache::~EncodeCache()
+{
+} // ~EncodeCache
+
+std::wstring EncodeCache::MakeKey(TTAuint64 pcm_hash, const TTA_info *info, TTAuint64 tag_hash)
+{
+	wchar_t key[80];
+
+	swprintf_s(key, 80, L"%016llx-%u-%u-%u-%016llx", pcm_hash, info->nch, info->sps, info->bps, tag_hash);
+	return key;
+}
+
+std::wstring EncodeCache::entry_path(const std::wstring &key) const
+{
+	return m_directory + key + L".tta";
+}
+
+// Copies a verified entry to filename. The entry is never linked into the user's
+// path, so later edits of the file cannot reach the cache, and the LRU stamp of
+// the entry is not shared with it.
+bool EncodeCache::Fetch(const std::wstring &key, const TTA_info *info, TTAuint64 id3v2_length, TTAuint64 apev2_length,
+	const wchar_t *filename)
+{
+	std::wstring entry = entry_path(key);
+	std::wstring temp = std::wstring(filename) + L".cache";
+	tta_file_layout layout;
+	LARGE_INTEGER file_size;
+	bool valid = false;
+
+	HANDLE hEntry = CreateFileW(entry.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hEntry == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	// copy next to the target first, so that a failure leaves filename as it was
+	HANDLE hFile = CreateFileW(temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(hEntry);
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	try
+	{
+		// the key is only a 64-bit hash: the entry has to be the file this encode would produce
+		tta_read_layout(hEntry, &layout);
+		if (!GetFileSizeEx(hEntry, &file_size) ||
+			layout.info.format != info->format || layout.info.nch != info->nch || layout.info.bps != info->bps ||
+			layout.info.sps != info->sps || layout.info.samples != info->samples ||
+			layout.header_offset != id3v2_length ||
+			static_cast<TTAuint64>(file_size.QuadPart) != layout.data_offset + layout.data_length + apev2_length)
+		{
+			throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		// tags, header and seek table; the last two were checked against their CRCs above
+		std::vector<TTAuint8> buffer(static_cast<size_t>(layout.data_offset));
+		tta_read_file(hEntry, 0, buffer.data(), static_cast<DWORD>(buffer.size()));
+		tta_write_file(hFile, 0, buffer.data(), static_cast<DWORD>(buffer.size()));
+
+		// every frame ends with a CRC of its own
+		TTAuint64 pos = layout.data_offset;
+		for (TTAuint32 frame_length : layout.seek_table)
+		{
+			if (frame_length < 4)
+			{
+				throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			buffer.resize(frame_length);
+			tta_read_file(hEntry, pos, buffer.data(), frame_length);
+
+			const TTAuint8 *crc = buffer.data() + frame_length - 4;
+			if (tta_crc32(buffer.data(), frame_length - 4) != (static_cast<TTAuint32>(crc[0]) | (static_cast<TTAuint32>(crc[1]) << 8) |
+				(static_cast<TTAuint32>(crc[2]) << 16) | (static_cast<TTAuint32>(crc[3]) << 24)))
+			{
+				throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			tta_write_file(hFile, pos, buffer.data(), frame_length);
+			pos += frame_length;
+		}
+
+		buffer.resize(static_cast<size_t>(apev2_length));
+		if (!buffer.empty())
+		{
+			tta_read_file(hEntry, pos, buffer.data(), static_cast<DWORD>(buffer.size()));
+			tta_write_file(hFile, pos, buffer.data(), static_cast<DWORD>(buffer.size()));
+		}
+		else
+		{
+			// Do nothing
+		}
+		valid = true;
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		// Do nothing
+	}
+
+	CloseHandle(hEntry);
+	if (!CloseHandle(hFile) || !valid)
+	{
+		DeleteFileW(temp.c_str());
+		if (!valid)
+		{
+			DeleteFileW(entry.c_str()); // damaged or a hash collision; the next store replaces it
+		}
+		else
+		{
+			// Do nothing
+		}
+		return false;
+	}
+	else if (!MoveFileExW(temp.c_str(), filename, MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileW(temp.c_str());
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	// refresh the LRU stamp of the entry
+	hEntry = CreateFileW(entry.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hEntry != INVALID_HANDLE_VALUE)
+	{
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		SetFileTime(hEntry, nullptr, nullptr, &now);
+		CloseHandle(hEntry);
+	}
+	else
+	{
+		// Do nothing
+	}
+	return true;
+}
+
+// a failed store only costs the cache entry
+void EncodeCache::Store(const std::wstring &key, const wchar_t *filename)
+{
+	std::wstring entry = entry_path(key);
+	wchar_t suffix[32];
+
+	swprintf_s(suffix, 32, L".%lu.%lu.tmp", GetCurrentProcessId(), GetCurrentThreadId());
+	std::wstring temp = m_directory + key + suffix;
+
+	if (CopyFileW(filename, temp.c_str(), FALSE))
+	{
+		if (!MoveFileExW(temp.c_str(), entry.c_str(), MOVEFILE_REPLACE_EXISTING))
+		{
+			DeleteFileW(temp.c_str());
+		}
+		else
+		{
+			evict();
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void EncodeCache::evict()
+{
+	struct cache_entry
+	{
+		std::wstring name;
+		TTAuint64 size;
+		TTAuint64 stamp;
+	};
+	std::vector<cache_entry> entries;
+	TTAuint64 total = 0;
+	WIN32_FIND_DATAW fd;
+
+	HANDLE hFind = FindFirstFileW((m_directory + L"*.tta").c_str(), &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	do
+	{
+		if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			cache_entry e;
+			e.name = fd.cFileName;
+			e.size = (static_cast<TTAuint64>(fd.nFileSizeHigh) << 32) | fd.nFileSizeLow;
+			e.stamp = (static_cast<TTAuint64>(fd.ftLastWriteTime.dwHighDateTime) << 32) | fd.ftLastWriteTime.dwLowDateTime;
+			total += e.size;
+			entries.push_back(e);
+		}
+		else
+		{
+			// Do nothing
+		}
+	} while (FindNextFileW(hFind, &fd));
+	FindClose(hFind);
+
+	if (total <= m_limit)
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	std::sort(entries.begin(), entries.end(),
+		[](const cache_entry &a, const cache_entry &b) { return a.stamp < b.stamp; });
+	for (const cache_entry &e : entries)
+	{
+		if (total <= m_limit)
+		{
+			break;
+		}
+		else if (DeleteFileW((m_directory + e.name).c_str()))
+		{
+			total -= e.size;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+}
@@ -0,0 +1,71 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENCODECACHE_H_INCLUDED
+#define ENCODECACHE_H_INCLUDED
+
+#include <windows.h>
+#include <string>
+#include <libtta.h>
+
+/////////////////////////// Streaming PCM hash ////////////////////////
+// XXH64 over everything passed to Update()
+class PcmHasher
+{
+public:
+	PcmHasher() { Reset(); }
+
+	void Reset();
+	void Update(const TTAuint8 *data, size_t length);
+	TTAuint64 Digest() const;
+
+private:
+	TTAuint64 m_acc[4] = {};
+	TTAuint64 m_total = 0;
+	TTAuint8 m_stripe[32] = {};
+	size_t m_stripe_length = 0;
+}; // class PcmHasher
+
+////////////////////// Content-addressed encode cache /////////////////
+// Finished TTA files stored under <directory>\<key>.tta. An entry's
+// last write time is its LRU stamp; Store() evicts the oldest entries
+// once the directory exceeds the size limit.
+class EncodeCache
+{
+public:
+	EncodeCache(const wchar_t *directory, TTAuint64 limit);
+	virtual ~EncodeCache();
+
+	static std::wstring MakeKey(TTAuint64 pcm_hash, const TTA_info *info, TTAuint64 tag_hash);
+
+	// replaces filename with a checked copy of the cached file; false on a miss
+	bool Fetch(const std::wstring &key, const TTA_info *info, TTAuint64 id3v2_length, TTAuint64 apev2_length,
+		const wchar_t *filename);
+	void Store(const std::wstring &key, const wchar_t *filename);
+
+private:
+	std::wstring entry_path(const std::wstring &key) const;
+	void evict();
+
+	std::wstring m_directory;
+	TTAuint64 m_limit = 0;
+}; // class EncodeCache
+
+#endif // #ifndef ENCODECACHE_H_INCLUDED
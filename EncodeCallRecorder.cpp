@@ -0,0 +1,165 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <string>
+
+#include "AudioCoderTTA.h"
+#include "EncodeCallRecorder.h"
+
+// Every coder records to a file of its own: "calls.ttac" becomes "calls-<pid>-<n>.ttac",
+// where n is the first number that does not overwrite an earlier recording.
+static HANDLE create_recording_file(const wchar_t *filename)
+{
+	static std::atomic<unsigned int> next_recording{ 0 };
+	std::wstring name(filename);
+	size_t dir_end = name.find_last_of(L"\\/");
+	size_t ext_pos = name.rfind(L'.');
+	std::wstring base = name;
+	std::wstring extension;
+
+	if (ext_pos != std::wstring::npos && (dir_end == std::wstring::npos || ext_pos > dir_end))
+	{
+		base = name.substr(0, ext_pos);
+		extension = name.substr(ext_pos);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	for (int attempt = 0; attempt < 1000; attempt++)
+	{
+		std::wstring unique_name = base + L"-" + std::to_wstring(GetCurrentProcessId()) + L"-" +
+			std::to_wstring(next_recording.fetch_add(1, std::memory_order_relaxed) + 1) + extension;
+		HANDLE hFile = CreateFileW(unique_name.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile != INVALID_HANDLE_VALUE || GetLastError() != ERROR_FILE_EXISTS)
+		{
+			return hFile;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	return INVALID_HANDLE_VALUE;
+}
+
+EncodeCallRecorder::EncodeCallRecorder(const wchar_t *filename, const TTA_info *info)
+{
+	encode_call_header header = {};
+	LARGE_INTEGER frequency;
+	DWORD dwBytesWritten = 0;
+
+	m_hFile = create_recording_file(filename);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	QueryPerformanceFrequency(&frequency);
+	memcpy(header.magic, ENCODE_CALL_MAGIC, 4);
+	header.version = ENCODE_CALL_VERSION;
+	header.nch = info->nch;
+	header.sps = info->sps;
+	header.bps = info->bps;
+	header.frequency = static_cast<TTAuint64>(frequency.QuadPart);
+
+	if (!WriteFile(m_hFile, &header, sizeof(header), &dwBytesWritten, nullptr))
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	m_records.reserve(ENCODE_CALL_RECORDS_PER_WRITE);
+	m_start = Now();
+}
+
+EncodeCallRecorder::~EncodeCallRecorder()
+{
+	Flush();
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	else
+	{
+		// Do nothing
+	}
+} // ~EncodeCallRecorder
+
+LONGLONG EncodeCallRecorder::Now()
+{
+	LARGE_INTEGER now;
+
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+void EncodeCallRecorder::Record(LONGLONG begin, int in_avail, int out_avail, int in_used, int out_used)
+{
+	encode_call_record record;
+	LONGLONG duration = Now() - begin;
+
+	record.begin = static_cast<TTAuint64>(begin - m_start);
+	record.duration = static_cast<TTAuint32>(min(duration, static_cast<LONGLONG>(0xFFFFFFFF)));
+	record.flags = m_flags;
+	record.in_avail = in_avail;
+	record.out_avail = out_avail;
+	record.in_used = in_used;
+	record.out_used = out_used;
+	m_records.push_back(record);
+	m_flags = 0;
+
+	if (m_records.size() == ENCODE_CALL_RECORDS_PER_WRITE)
+	{
+		Flush();
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+// a failed write drops the records rather than failing the encode
+void EncodeCallRecorder::Flush()
+{
+	DWORD dwBytesWritten = 0;
+
+	if (m_hFile != INVALID_HANDLE_VALUE && !m_records.empty())
+	{
+		WriteFile(m_hFile, m_records.data(), static_cast<DWORD>(m_records.size() * sizeof(encode_call_record)), &dwBytesWritten, nullptr);
+	}
+	else
+	{
+		// Do nothing
+	}
+	m_records.clear();
+}
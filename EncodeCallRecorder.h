@@ -0,0 +1,84 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENCODECALLRECORDER_H_INCLUDED
+#define ENCODECALLRECORDER_H_INCLUDED
+
+#include <windows.h>
+#include <vector>
+#include <libtta.h>
+
+static const char ENCODE_CALL_MAGIC[4] = { 'T', 'T', 'A', 'C' };
+static const TTAuint32 ENCODE_CALL_VERSION = 1;
+static const TTAuint32 ENCODE_CALL_FLAG_LAST = 0x1;	// PrepareToFinish() was called before this call
+static const size_t ENCODE_CALL_RECORDS_PER_WRITE = 4096;
+
+// file header, followed by encode_call_record entries up to the end of file
+struct encode_call_header
+{
+	char magic[4];
+	TTAuint32 version;
+	TTAuint32 nch;
+	TTAuint32 sps;
+	TTAuint32 bps;
+	TTAuint32 reserved;
+	TTAuint64 frequency;	// QueryPerformanceFrequency() of the recording machine
+};
+
+struct encode_call_record
+{
+	TTAuint64 begin;		// ticks since the recording started
+	TTAuint32 duration;		// ticks spent in Encode(), saturated
+	TTAuint32 flags;
+	TTAint32 in_avail;
+	TTAint32 out_avail;
+	TTAint32 in_used;
+	TTAint32 out_used;
+};
+
+static_assert(sizeof(encode_call_header) == 32, "encode_call_header must stay 32 bytes");
+static_assert(sizeof(encode_call_record) == 32, "encode_call_record must stay 32 bytes");
+
+////////////////////// Encode() call pattern recorder /////////////////
+// Logs the sizes and timing of every AudioCoderTTA::Encode() call, so
+// that "tta_tool replay" can run the same call pattern offline. The
+// file name gets a per-coder suffix, so concurrent encodes never share
+// or overwrite a recording.
+class EncodeCallRecorder
+{
+public:
+	EncodeCallRecorder(const wchar_t *filename, const TTA_info *info);
+	virtual ~EncodeCallRecorder();
+
+	static LONGLONG Now();
+
+	void MarkLast() { m_flags |= ENCODE_CALL_FLAG_LAST; }
+	void Record(LONGLONG begin, int in_avail, int out_avail, int in_used, int out_used);
+	void Flush();
+
+private:
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;
+	LONGLONG m_start = 0;
+	TTAuint32 m_flags = 0;
+	std::vector<encode_call_record> m_records;
+
+}; // class EncodeCallRecorder
+
+#endif // #ifndef ENCODECALLRECORDER_H_INCLUDED
@@ -0,0 +1,239 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <intrin.h>
+
+#include "ResourceGovernor.h"
+
+static LONGLONG query_counter()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+static LONGLONG query_frequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+}
+
+// CPU cycles spent by the calling thread; unlike GetThreadTimes() this is not
+// rounded to the 15.6ms clock tick, which is longer than a single Encode() call
+static ULONGLONG query_thread_cycles()
+{
+	ULONGLONG cycles = 0;
+
+	if (!QueryThreadCycleTime(GetCurrentThread(), &cycles))
+	{
+		return 0;
+	}
+	else
+	{
+		// Do nothing
+	}
+	return cycles;
+}
+
+// thread cycles count at the time stamp counter rate, which is measured once against the performance counter
+static double cycles_per_second()
+{
+	static std::once_flag once;
+	static double rate = 0.0;
+
+	std::call_once(once, []()
+	{
+		LONGLONG counter_begin = query_counter();
+		ULONGLONG tsc_begin = __rdtsc();
+		Sleep(20);
+		ULONGLONG tsc_end = __rdtsc();
+		LONGLONG counter_end = query_counter();
+
+		rate = static_cast<double>(tsc_end - tsc_begin) * static_cast<double>(query_frequency()) /
+			static_cast<double>(counter_end - counter_begin);
+	});
+	return rate;
+}
+
+// every governed coder configures the buckets, so only a changed rate starts them afresh
+void TokenBucket::SetRate(double rate, double burst)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	if (m_rate != rate || m_burst != burst)
+	{
+		m_rate = rate;
+		m_burst = burst;
+		m_tokens = burst;
+		m_frequency = query_frequency();
+		m_last = query_counter();
+		m_enabled.store(rate > 0.0, std::memory_order_relaxed);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void TokenBucket::refill()
+{
+	LONGLONG now = query_counter();
+
+	m_tokens += static_cast<double>(now - m_last) * m_rate / static_cast<double>(m_frequency);
+	if (m_tokens > m_burst)
+	{
+		m_tokens = m_burst;
+	}
+	else
+	{
+		// Do nothing
+	}
+	m_last = now;
+}
+
+void TokenBucket::Consume(double tokens)
+{
+	DWORD wait = 0;
+
+	if (!IsEnabled())
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	// the debt is taken under the lock, so concurrent callers queue up behind each other
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+
+		refill();
+		m_tokens -= tokens;
+		if (m_tokens < 0.0 && m_rate > 0.0)
+		{
+			wait = static_cast<DWORD>(-m_tokens * 1000.0 / m_rate) + 1;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+
+	if (wait != 0)
+	{
+		Sleep(wait);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+// a governor without a limit leaves the shared buckets to the governors that have one
+void ResourceGovernor::Configure(int cpu_share, ULONGLONG io_bytes_per_second)
+{
+	// up to 100ms of CPU and 250ms of I/O may run unpaced
+	m_cpu_governed = (cpu_share > 0 && cpu_share < 100);
+	if (m_cpu_governed)
+	{
+		s_cpu.SetRate(cpu_share / 100.0, 0.1);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	m_io_governed = (io_bytes_per_second > 0);
+	if (m_io_governed)
+	{
+		s_io.SetRate(static_cast<double>(io_bytes_per_second), io_bytes_per_second / 4.0);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void ResourceGovernor::BeginWork()
+{
+	m_work_begin = (m_cpu_governed && s_cpu.IsEnabled()) ? query_thread_cycles() : 0;
+}
+
+// charges the CPU time of this thread, not the wall time, which would include time spent preempted
+void ResourceGovernor::EndWork()
+{
+	if (m_work_begin != 0)
+	{
+		ULONGLONG now = query_thread_cycles();
+		double rate = cycles_per_second();
+		s_cpu.Consume((now > m_work_begin && rate > 0.0) ? static_cast<double>(now - m_work_begin) / rate : 0.0);
+		m_work_begin = 0;
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void ResourceGovernor::ThrottleIO(DWORD bytes)
+{
+	if (m_io_governed)
+	{
+		s_io.Consume(static_cast<double>(bytes));
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+GovernedPriorityScope::GovernedPriorityScope(const ResourceGovernor *governor)
+{
+	if (governor->IsEnabled())
+	{
+		m_saved_priority = GetThreadPriority(GetCurrentThread());
+		if (m_saved_priority > THREAD_PRIORITY_BELOW_NORMAL && m_saved_priority != THREAD_PRIORITY_ERROR_RETURN)
+		{
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+		}
+		else
+		{
+			m_saved_priority = THREAD_PRIORITY_ERROR_RETURN;
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+GovernedPriorityScope::~GovernedPriorityScope()
+{
+	if (m_saved_priority != THREAD_PRIORITY_ERROR_RETURN)
+	{
+		SetThreadPriority(GetCurrentThread(), m_saved_priority);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
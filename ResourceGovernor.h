@@ -0,0 +1,86 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESOURCEGOVERNOR_H_INCLUDED
+#define RESOURCEGOVERNOR_H_INCLUDED
+
+#include <windows.h>
+#include <atomic>
+#include <mutex>
+
+////////////////////////////// Token bucket ///////////////////////////
+// Tokens refill at a fixed rate up to a burst size. Consume() takes the
+// tokens even when that leaves the bucket in debt, then sleeps until
+// the debt is repaid. Buckets are shared between threads.
+class TokenBucket
+{
+public:
+	void SetRate(double rate, double burst);
+	bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+	void Consume(double tokens);
+
+private:
+	void refill();
+
+	std::mutex m_lock;
+	std::atomic<bool> m_enabled{ false };
+	double m_rate = 0.0;	// tokens per second, 0 for unlimited
+	double m_burst = 0.0;
+	double m_tokens = 0.0;
+	LONGLONG m_last = 0;
+	LONGLONG m_frequency = 0;
+}; // class TokenBucket
+
+/////////////////////////// Resource governor /////////////////////////
+// Paces encoding to a share of one CPU and finalize I/O to a byte rate.
+// The budgets are per process: every governor that was configured with a
+// limit draws from the same buckets, while the others are never paced.
+class ResourceGovernor
+{
+public:
+	void Configure(int cpu_share, ULONGLONG io_bytes_per_second); // 100 / 0 to disable
+	bool IsEnabled() const { return (m_cpu_governed && s_cpu.IsEnabled()) || (m_io_governed && s_io.IsEnabled()); }
+
+	// brackets one unit of CPU work; EndWork() sleeps to keep the share
+	void BeginWork();
+	void EndWork();
+
+	void ThrottleIO(DWORD bytes);
+
+private:
+	inline static TokenBucket s_cpu;	// tokens are seconds of CPU time
+	inline static TokenBucket s_io;		// tokens are bytes
+	bool m_cpu_governed = false;
+	bool m_io_governed = false;
+	ULONGLONG m_work_begin = 0;			// thread CPU cycles, 0 when not measuring
+}; // class ResourceGovernor
+
+// runs the calling thread below normal priority while the governor is enabled
+class GovernedPriorityScope
+{
+public:
+	explicit GovernedPriorityScope(const ResourceGovernor *governor);
+	~GovernedPriorityScope();
+
+private:
+	int m_saved_priority = THREAD_PRIORITY_ERROR_RETURN;
+}; // class GovernedPriorityScope
+
+#endif // #ifndef RESOURCEGOVERNOR_H_INCLUDED
@@ -0,0 +1,607 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <array>
+
+#include <libtta.h>
+
+#include "AudioCoderTTA.h"
+#include "TTAContainer.h"
+
+static constexpr std::array<TTAuint32, 256> crc32_table = []()
+{
+	std::array<TTAuint32, 256> table{};
+	for (TTAuint32 i = 0; i < 256; i++)
+	{
+		TTAuint32 c = i;
+		for (int k = 0; k < 8; k++)
+		{
+			c = (c & 1) ? (0xEDB88320UL ^ (c >> 1)) : (c >> 1);
+		}
+		table[i] = c;
+	}
+	return table;
+}();
+
+static __forceinline void put_uint16(TTAuint8 *out, TTAuint32 value)
+{
+	out[0] = static_cast<TTAuint8>(value);
+	out[1] = static_cast<TTAuint8>(value >> 8);
+}
+
+static __forceinline void put_uint32(TTAuint8 *out, TTAuint32 value)
+{
+	out[0] = static_cast<TTAuint8>(value);
+	out[1] = static_cast<TTAuint8>(value >> 8);
+	out[2] = static_cast<TTAuint8>(value >> 16);
+	out[3] = static_cast<TTAuint8>(value >> 24);
+}
+
+static __forceinline TTAuint32 get_uint16(const TTAuint8 *in)
+{
+	return static_cast<TTAuint32>(in[0]) | (static_cast<TTAuint32>(in[1]) << 8);
+}
+
+static __forceinline TTAuint32 get_uint32(const TTAuint8 *in)
+{
+	return static_cast<TTAuint32>(in[0]) | (static_cast<TTAuint32>(in[1]) << 8) |
+		(static_cast<TTAuint32>(in[2]) << 16) | (static_cast<TTAuint32>(in[3]) << 24);
+}
+
+static __forceinline TTAuint32 get_uint32_be(const TTAuint8 *in)
+{
+	return (static_cast<TTAuint32>(in[0]) << 24) | (static_cast<TTAuint32>(in[1]) << 16) |
+		(static_cast<TTAuint32>(in[2]) << 8) | static_cast<TTAuint32>(in[3]);
+}
+
+void tta_read_file(HANDLE hFile, TTAuint64 offset, TTAuint8 *buffer, DWORD length)
+{
+	LARGE_INTEGER pos;
+	DWORD dwBytesRead = 0;
+
+	pos.QuadPart = static_cast<LONGLONG>(offset);
+	if (!SetFilePointerEx(hFile, pos, nullptr, FILE_BEGIN))
+	{
+		throw AudioCoderTTA_exception(TTA_SEEK_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (!ReadFile(hFile, buffer, length, &dwBytesRead, nullptr) || dwBytesRead != length)
+	{
+		throw AudioCoderTTA_exception(TTA_READ_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void tta_write_file(HANDLE hFile, TTAuint64 offset, const TTAuint8 *buffer, DWORD length)
+{
+	LARGE_INTEGER pos;
+	DWORD dwBytesWritten = 0;
+
+	pos.QuadPart = static_cast<LONGLONG>(offset);
+	if (!SetFilePointerEx(hFile, pos, nullptr, FILE_BEGIN))
+	{
+		throw AudioCoderTTA_exception(TTA_SEEK_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (!WriteFile(hFile, buffer, length, &dwBytesWritten, nullptr) || dwBytesWritten != length)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+TTAuint32 tta_crc32(const TTAuint8 *data, size_t length)
+{
+	return tta_crc32_update(0, data, length);
+}
+
+// continues a CRC32 over further data; start with 0
+TTAuint32 tta_crc32_update(TTAuint32 crc, const TTAuint8 *data, size_t length)
+{
+	crc ^= 0xFFFFFFFFUL;
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFFUL;
+}
+
+TTAuint32 tta_frame_length(TTAuint32 sps)
+{
+	return static_cast<TTAuint32>((static_cast<TTAuint64>(sps) * 256) / 245);
+}
+
+TTAuint32 tta_frame_count(TTAuint32 samples, TTAuint32 sps)
+{
+	TTAuint32 flen_std = tta_frame_length(sps);
+	return samples / flen_std + ((samples % flen_std) ? 1 : 0);
+}
+
+void tta_write_header(TTAuint8 *out, const TTA_info *info)
+{
+	out[0] = 'T';
+	out[1] = 'T';
+	out[2] = 'A';
+	out[3] = '1';
+	put_uint16(out + 4, info->format);
+	put_uint16(out + 6, info->nch);
+	put_uint16(out + 8, info->bps);
+	put_uint32(out + 10, info->sps);
+	put_uint32(out + 14, info->samples);
+	put_uint32(out + 18, tta_crc32(out, TTA_HEADER_SIZE - 4));
+}
+
+size_t tta_write_seek_table(TTAuint8 *out, const TTAuint32 *seek_table, size_t frames)
+{
+	for (size_t i = 0; i < frames; i++)
+	{
+		put_uint32(out + i * 4, seek_table[i]);
+	}
+	put_uint32(out + frames * 4, tta_crc32(out, frames * 4));
+	return frames * 4 + 4;
+}
+
+void tta_read_layout(HANDLE hFile, tta_file_layout *layout)
+{
+	TTAuint8 header[TTA_HEADER_SIZE];
+
+	// skip ID3v2 tag
+	tta_read_file(hFile, 0, header, 10);
+	layout->header_offset = 0;
+	if (header[0] == 'I' && header[1] == 'D' && header[2] == '3')
+	{
+		layout->header_offset = 10 + ((static_cast<TTAuint64>(header[6] & 0x7F) << 21) |
+			(static_cast<TTAuint64>(header[7] & 0x7F) << 14) |
+			(static_cast<TTAuint64>(header[8] & 0x7F) << 7) |
+			static_cast<TTAuint64>(header[9] & 0x7F));
+		if (header[5] & 0x10)
+		{
+			layout->header_offset += 10; // footer present
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	tta_read_file(hFile, layout->header_offset, header, TTA_HEADER_SIZE);
+	if (header[0] != 'T' || header[1] != 'T' || header[2] != 'A' || header[3] != '1')
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else if (tta_crc32(header, TTA_HEADER_SIZE - 4) != get_uint32(header + 18))
+	{
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	layout->info.format = get_uint16(header + 4);
+	layout->info.nch = get_uint16(header + 6);
+	layout->info.bps = get_uint16(header + 8);
+	layout->info.sps = get_uint32(header + 10);
+	layout->info.samples = get_uint32(header + 14);
+
+	if ((layout->info.nch == 0) ||
+		(layout->info.nch > MAX_NCH) ||
+		(layout->info.bps == 0) ||
+		(layout->info.bps > MAX_BPS) ||
+		(tta_frame_length(layout->info.sps) == 0))
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	layout->flen_std = tta_frame_length(layout->info.sps);
+
+	TTAuint32 frames = tta_frame_count(layout->info.samples, layout->info.sps);
+	std::vector<TTAuint8> table(static_cast<size_t>(frames) * 4 + 4);
+
+	tta_read_file(hFile, layout->header_offset + TTA_HEADER_SIZE, table.data(), static_cast<DWORD>(table.size()));
+	if (tta_crc32(table.data(), table.size() - 4) != get_uint32(table.data() + table.size() - 4))
+	{
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	layout->seek_table.resize(frames);
+	layout->data_length = 0;
+	for (TTAuint32 i = 0; i < frames; i++)
+	{
+		layout->seek_table[i] = get_uint32(table.data() + i * 4);
+		layout->data_length += layout->seek_table[i];
+	}
+	layout->data_offset = layout->header_offset + TTA_HEADER_SIZE + table.size();
+}
+
+TTAuint64 tta_frame_offset(const tta_file_layout *layout, size_t frame)
+{
+	TTAuint64 offset = layout->data_offset;
+
+	for (size_t i = 0; i < frame; i++)
+	{
+		offset += layout->seek_table[i];
+	}
+	return offset;
+}
+
+struct TTA_memory_reader
+{
+	TTA_io_callback iocb{};
+	const TTAuint8 *data = nullptr;
+	size_t data_length = 0;
+	size_t current_pos = 0;
+};
+
+static TTAint32 CALLBACK memory_read_callback(TTA_io_callback *io, TTAuint8 *buffer, TTAuint32 size)
+{
+	TTA_memory_reader *reader = reinterpret_cast<TTA_memory_reader*>(io);
+	size_t l = min(static_cast<size_t>(size), reader->data_length - reader->current_pos);
+
+	memcpy_s(buffer, size, reader->data + reader->current_pos, l);
+	reader->current_pos += l;
+	return static_cast<TTAint32>(l);
+} // memory_read_callback
+
+static TTAint64 CALLBACK memory_seek_callback(TTA_io_callback *io, TTAint64 offset)
+{
+	TTA_memory_reader *reader = reinterpret_cast<TTA_memory_reader*>(io);
+
+	if (offset >= 0 && static_cast<size_t>(offset) <= reader->data_length)
+	{
+		reader->current_pos = static_cast<size_t>(offset);
+		return offset;
+	}
+	else
+	{
+		// Do nothing
+	}
+	return 0;
+} // memory_seek_callback
+
+int tta_decode_frame(const TTA_info *info, TTAuint32 frame, const TTAuint8 *data, TTAuint32 data_length,
+	TTAuint8 *output, TTAuint32 out_bytes)
+{
+	alignas(16) TTA_memory_reader reader;
+	TTA_info frame_info = *info;
+
+	reader.iocb.read = &memory_read_callback;
+	reader.iocb.write = nullptr;
+	reader.iocb.seek = &memory_seek_callback;
+	reader.data = data;
+	reader.data_length = data_length;
+	reader.current_pos = 0;
+
+	try
+	{
+		tta::tta_decoder decoder(&reader.iocb);
+		decoder.init_set_info(&frame_info);
+		decoder.frame_reset(frame, &reader.iocb);
+		return decoder.process_frame(data_length, output, out_bytes);
+	}
+	catch (tta::tta_exception &ex)
+	{
+		throw AudioCoderTTA_exception(ex.code());
+	}
+}
+
+// APEv2 keys: 2 to 255 printable ASCII characters, except the reserved ones
+bool tta_tag_key_valid(const char *key)
+{
+	size_t length = strlen(key);
+
+	if (length < 2 || length > 255 ||
+		!lstrcmpiA(key, "ID3") || !lstrcmpiA(key, "TAG") || !lstrcmpiA(key, "OggS") || !lstrcmpiA(key, "MP+"))
+	{
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	for (size_t i = 0; i < length; i++)
+	{
+		if (key[i] < 0x20 || key[i] > 0x7E)
+		{
+			return false;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	return true;
+}
+
+static void put_syncsafe(TTAuint8 *out, TTAuint32 value)
+{
+	out[0] = static_cast<TTAuint8>((value >> 21) & 0x7F);
+	out[1] = static_cast<TTAuint8>((value >> 14) & 0x7F);
+	out[2] = static_cast<TTAuint8>((value >> 7) & 0x7F);
+	out[3] = static_cast<TTAuint8>(value & 0x7F);
+}
+
+static TTAuint32 get_syncsafe(const TTAuint8 *in)
+{
+	return (static_cast<TTAuint32>(in[0] & 0x7F) << 21) |
+		(static_cast<TTAuint32>(in[1] & 0x7F) << 14) |
+		(static_cast<TTAuint32>(in[2] & 0x7F) << 7) |
+		static_cast<TTAuint32>(in[3] & 0x7F);
+}
+
+// Zero padding at the end of a leading ID3v2.3/2.4 tag that ends at header_offset.
+// Returns false when there is no such tag or it uses a layout that cannot be walked safely.
+bool tta_id3v2_padding(HANDLE hFile, TTAuint64 header_offset, TTAuint64 *padding)
+{
+	TTAuint8 header[10];
+
+	*padding = 0;
+	if (header_offset < 10)
+	{
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	tta_read_file(hFile, 0, header, 10);
+	if (header[0] != 'I' || header[1] != 'D' || header[2] != '3' ||
+		(header[3] != 3 && header[3] != 4) ||
+		(header[5] & 0xD0) != 0 ||	// unsynchronisation, extended header or footer
+		10 + static_cast<TTAuint64>(get_syncsafe(header + 6)) != header_offset)
+	{
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	std::vector<TTAuint8> body(static_cast<size_t>(header_offset - 10));
+	tta_read_file(hFile, 10, body.data(), static_cast<DWORD>(body.size()));
+
+	TTAuint64 pos = 0;
+	while (pos + 10 <= body.size() && body[static_cast<size_t>(pos)] != 0)
+	{
+		const TTAuint8 *frame = &body[static_cast<size_t>(pos)];
+		pos += 10 + static_cast<TTAuint64>((header[3] == 4) ? get_syncsafe(frame + 4) : get_uint32_be(frame + 4));
+	}
+
+	if (pos > body.size())
+	{
+		return false;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	for (size_t i = static_cast<size_t>(pos); i < body.size(); i++)
+	{
+		if (body[i] != 0)
+		{
+			return false;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	*padding = body.size() - pos;
+	return true;
+}
+
+// Rewrites the size field of a leading ID3v2 tag; header_offset is the new end of the tag
+void tta_id3v2_resize(HANDLE hFile, TTAuint64 header_offset)
+{
+	TTAuint8 size[4];
+
+	put_syncsafe(size, static_cast<TTAuint32>(header_offset - 10));
+	tta_write_file(hFile, 6, size, 4);
+}
+
+// ID3v2.4 frame id for the usual APEv2 keys; others go to TXXX
+static const char *id3v2_frame_id(const char *key)
+{
+	static const char *const map[][2] = {
+		{ "Title", "TIT2" }, { "Artist", "TPE1" }, { "Album", "TALB" },
+		{ "Album Artist", "TPE2" }, { "Composer", "TCOM" }, { "Year", "TDRC" },
+		{ "Track", "TRCK" }, { "Disc", "TPOS" }, { "Genre", "TCON" },
+		{ "Comment", "COMM" }, { "Copyright", "TCOP" }, { "Publisher", "TPUB" },
+	};
+
+	for (const auto &entry : map)
+	{
+		if (!lstrcmpiA(key, entry[0]))
+		{
+			return entry[1];
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	return "TXXX";
+}
+
+// ID3v2.4 tag with UTF-8 text frames followed by padding bytes; empty output for
+// no tags and no padding
+void tta_build_id3v2(const std::vector<tta_tag_item> *tags, size_t padding, std::vector<TTAuint8> *out)
+{
+	out->clear();
+	if (tags->empty() && padding == 0)
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	out->resize(10);
+	for (const auto &tag : *tags)
+	{
+		const char *id = id3v2_frame_id(tag.key.c_str());
+		size_t frame_pos = out->size();
+
+		out->resize(frame_pos + 10);
+		out->push_back(3); // UTF-8
+		if (!strcmp(id, "COMM"))
+		{
+			out->insert(out->end(), { 'X', 'X', 'X', 0 }); // unknown language, empty description
+		}
+		else if (!strcmp(id, "TXXX"))
+		{
+			out->insert(out->end(), tag.key.begin(), tag.key.end());
+			out->push_back(0);
+		}
+		else
+		{
+			// Do nothing
+		}
+		out->insert(out->end(), tag.value.begin(), tag.value.end());
+
+		TTAuint8 *frame = out->data() + frame_pos;
+		memcpy(frame, id, 4);
+		put_syncsafe(frame + 4, static_cast<TTAuint32>(out->size() - frame_pos - 10));
+		frame[8] = 0;
+		frame[9] = 0;
+	}
+
+	out->resize(out->size() + padding, 0);
+
+	TTAuint8 *header = out->data();
+	memcpy(header, "ID3", 3);
+	header[3] = 4; // version 2.4.0
+	header[4] = 0;
+	header[5] = 0; // no flags
+	put_syncsafe(header + 6, static_cast<TTAuint32>(out->size() - 10));
+}
+
+// APEv2 tag with header and footer; empty output for no tags
+void tta_build_apev2(const std::vector<tta_tag_item> *tags, std::vector<TTAuint8> *out)
+{
+	static const TTAuint32 APE_TAG_HEADER_SIZE = 32;
+	static const TTAuint32 APE_FLAG_HAS_HEADER = 0x80000000UL;
+	static const TTAuint32 APE_FLAG_IS_HEADER = 0x20000000UL;
+
+	out->clear();
+	if (tags->empty())
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	out->resize(APE_TAG_HEADER_SIZE);
+	for (const auto &tag : *tags)
+	{
+		size_t item_pos = out->size();
+
+		out->resize(item_pos + 8);
+		put_uint32(out->data() + item_pos, static_cast<TTAuint32>(tag.value.size()));
+		put_uint32(out->data() + item_pos + 4, 0); // UTF-8 text
+		out->insert(out->end(), tag.key.begin(), tag.key.end());
+		out->push_back(0);
+		out->insert(out->end(), tag.value.begin(), tag.value.end());
+	}
+
+	// tag size covers the items and the footer, not the header
+	TTAuint32 tag_size = static_cast<TTAuint32>(out->size());
+	out->resize(tag_size + APE_TAG_HEADER_SIZE);
+
+	for (int i = 0; i < 2; i++)
+	{
+		TTAuint8 *p = out->data() + ((i == 0) ? 0 : tag_size);
+		memcpy(p, "APETAGEX", 8);
+		put_uint32(p + 8, 2000);
+		put_uint32(p + 12, tag_size);
+		put_uint32(p + 16, static_cast<TTAuint32>(tags->size()));
+		put_uint32(p + 20, (i == 0) ? (APE_FLAG_HAS_HEADER | APE_FLAG_IS_HEADER) : APE_FLAG_HAS_HEADER);
+		memset(p + 24, 0, 8);
+	}
+}
+
+// combined size of the tags built by tta_build_id3v2() and tta_build_apev2()
+size_t tta_tag_size(const std::vector<tta_tag_item> *tags)
+{
+	size_t size = 0;
+
+	if (tags->empty())
+	{
+		return 0;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	size = 10 + 32 * 2;
+	for (const auto &tag : *tags)
+	{
+		const char *id = id3v2_frame_id(tag.key.c_str());
+
+		size += 10 + 1 + tag.value.size();
+		if (!strcmp(id, "COMM"))
+		{
+			size += 4;
+		}
+		else if (!strcmp(id, "TXXX"))
+		{
+			size += tag.key.size() + 1;
+		}
+		else
+		{
+			// Do nothing
+		}
+		size += 8 + tag.key.size() + 1 + tag.value.size();
+	}
+	return size;
+}
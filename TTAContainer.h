@@ -0,0 +1,73 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TTACONTAINER_H_INCLUDED
+#define TTACONTAINER_H_INCLUDED
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <libtta.h>
+
+static const TTAuint32 TTA_HEADER_SIZE = 22;	// "TTA1" + format + nch + bps + sps + samples + crc32
+
+// Layout of an existing TTA1 file as found on disk
+struct tta_file_layout
+{
+	TTA_info info{};
+	TTAuint64 header_offset = 0;	// size of a leading ID3v2 tag, if any
+	TTAuint64 data_offset = 0;		// first byte of the first frame
+	TTAuint64 data_length = 0;		// sum of all frame sizes
+	TTAuint32 flen_std = 0;			// samples per frame (all frames but the last)
+	std::vector<TTAuint32> seek_table;
+};
+
+// One tag field; key is an APEv2 item key ("Title", "Artist", ...), value is UTF-8
+struct tta_tag_item
+{
+	std::string key;
+	std::string value;
+};
+
+/////////////////////// TTA container helpers /////////////////////////
+TTAuint32 tta_crc32(const TTAuint8 *data, size_t length);
+TTAuint32 tta_crc32_update(TTAuint32 crc, const TTAuint8 *data, size_t length);
+TTAuint32 tta_frame_length(TTAuint32 sps);
+TTAuint32 tta_frame_count(TTAuint32 samples, TTAuint32 sps);
+
+void tta_write_header(TTAuint8 *out, const TTA_info *info);
+size_t tta_write_seek_table(TTAuint8 *out, const TTAuint32 *seek_table, size_t frames);
+
+void tta_read_file(HANDLE hFile, TTAuint64 offset, TTAuint8 *buffer, DWORD length);
+void tta_write_file(HANDLE hFile, TTAuint64 offset, const TTAuint8 *buffer, DWORD length);
+void tta_read_layout(HANDLE hFile, tta_file_layout *layout);
+TTAuint64 tta_frame_offset(const tta_file_layout *layout, size_t frame);
+
+bool tta_tag_key_valid(const char *key);
+void tta_build_id3v2(const std::vector<tta_tag_item> *tags, size_t padding, std::vector<TTAuint8> *out);
+void tta_build_apev2(const std::vector<tta_tag_item> *tags, std::vector<TTAuint8> *out);
+size_t tta_tag_size(const std::vector<tta_tag_item> *tags);
+bool tta_id3v2_padding(HANDLE hFile, TTAuint64 header_offset, TTAuint64 *padding);
+void tta_id3v2_resize(HANDLE hFile, TTAuint64 header_offset);
+
+int tta_decode_frame(const TTA_info *info, TTAuint32 frame, const TTAuint8 *data, TTAuint32 data_length,
+	TTAuint8 *output, TTAuint32 out_bytes);
+
+#endif // #ifndef TTACONTAINER_H_INCLUDED
@@ -0,0 +1,559 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include <libtta.h>
+
+#include "AudioCoderTTA.h"
+#include "TTAContainer.h"
+#include "TTAEditor.h"
+
+static const DWORD COPY_BUFFER_SIZE = 65536;
+
+TTASpliceWriter::TTASpliceWriter(const wchar_t *filename, const TTA_info *info)
+	: m_info(*info), m_flen_std(tta_frame_length(info->sps)), m_filename(filename)
+{
+	if ((m_info.format != TTA_FORMAT_SIMPLE) ||
+		(m_info.nch == 0) ||
+		(m_info.nch > MAX_NCH) ||
+		(m_info.bps == 0) ||
+		(m_info.bps > MAX_BPS) ||
+		(m_flen_std == 0))
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	TTAuint32 frames = tta_frame_count(m_info.samples, m_info.sps);
+	m_seek_table.reserve(frames);
+
+	m_hFile = CreateFileW(filename, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	// leave room for the header and seek table, they are written by finish()
+	LARGE_INTEGER pos;
+	pos.QuadPart = static_cast<LONGLONG>(TTA_HEADER_SIZE) + static_cast<LONGLONG>(frames) * 4 + 4;
+	if (!SetFilePointerEx(m_hFile, pos, nullptr, FILE_BEGIN))
+	{
+		CloseHandle(m_hFile);
+		DeleteFileW(m_filename.c_str());
+		throw AudioCoderTTA_exception(TTA_SEEK_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+TTASpliceWriter::~TTASpliceWriter()
+{
+	m_coder.reset();
+
+	if (m_hTempFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hTempFile);
+		m_hTempFile = INVALID_HANDLE_VALUE;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (m_szTempFileName[0] != L'\0')
+	{
+		DeleteFileW(m_szTempFileName);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	// an unfinished output is not a valid TTA file
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+		DeleteFileW(m_filename.c_str());
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+bool TTASpliceWriter::can_copy(TTAuint32 samples) const
+{
+	// only the last frame of a stream may be shorter than flen_std
+	return aligned() &&
+		(static_cast<TTAuint64>(m_samples) + samples <= m_info.samples) &&
+		((samples == m_flen_std) || (m_samples + samples == m_info.samples));
+}
+
+void TTASpliceWriter::write(const TTAuint8 *data, DWORD size)
+{
+	DWORD dwBytesWritten = 0;
+
+	if (!WriteFile(m_hFile, data, size, &dwBytesWritten, nullptr) || dwBytesWritten != size)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void TTASpliceWriter::copy_frame(const TTAuint8 *frame, TTAuint32 size, TTAuint32 samples)
+{
+	if (!can_copy(samples))
+	{
+		throw AudioCoderTTA_exception(TTA_NOT_SUPPORTED);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	write(frame, size);
+	m_seek_table.push_back(size);
+	m_samples += samples;
+}
+
+void TTASpliceWriter::encode(TTAuint8 *pcm, TTAuint32 samples)
+{
+	DWORD dwBytesWritten = 0;
+
+	if (static_cast<TTAuint64>(m_samples) + samples > m_info.samples)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (m_coder == nullptr)
+	{
+		wchar_t szTempPath[MAX_PATH];
+
+		if (GetTempPathW(MAX_PATH, szTempPath) == 0 || GetTempFileNameW(szTempPath, L"tta", 0, m_szTempFileName) == 0)
+		{
+			throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		m_hTempFile = CreateFileW(m_szTempFileName, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_hTempFile == INVALID_HANDLE_VALUE)
+		{
+			throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		m_coder.reset(new AudioCoderTTA(static_cast<int>(m_info.nch), static_cast<int>(m_info.sps), static_cast<int>(m_info.bps)));
+		m_out_buffer.resize(COPY_BUFFER_SIZE);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	TTAuint8 *in = pcm;
+	int in_avail = static_cast<int>(samples * m_info.nch * ((m_info.bps + 7) / 8));
+	int in_used = 0;
+
+	for (;;)
+	{
+		int out_used = m_coder->Encode(0, in, in_avail, &in_used, m_out_buffer.data(), static_cast<int>(m_out_buffer.size()));
+		if (!WriteFile(m_hTempFile, m_out_buffer.data(), static_cast<DWORD>(out_used), &dwBytesWritten, nullptr))
+		{
+			throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		in += in_used;
+		in_avail -= in_used;
+		if (out_used == 0 && in_avail == 0)
+		{
+			break;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	m_samples += samples;
+}
+
+void TTASpliceWriter::append_encoded()
+{
+	DWORD dwBytesWritten = 0;
+	DWORD dwBytesRead = 0;
+	TTAuint8 dummy = 0;
+	int in_used = 0;
+	int out_used = 0;
+
+	m_coder->PrepareToFinish();
+	do
+	{
+		out_used = m_coder->Encode(0, &dummy, 0, &in_used, m_out_buffer.data(), static_cast<int>(m_out_buffer.size()));
+		if (!WriteFile(m_hTempFile, m_out_buffer.data(), static_cast<DWORD>(out_used), &dwBytesWritten, nullptr))
+		{
+			throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+	} while (out_used > 0);
+
+	if (!CloseHandle(m_hTempFile))
+	{
+		m_hTempFile = INVALID_HANDLE_VALUE;
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+	}
+	else
+	{
+		m_hTempFile = INVALID_HANDLE_VALUE;
+	}
+
+	m_coder->FinishAudio(m_szTempFileName);
+	m_coder.reset();
+
+	// move the frames of the encoded tail behind the copied ones
+	tta_file_layout layout;
+	HANDLE hTempFile = CreateFileW(m_szTempFileName, GENERIC_READ, 0, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (hTempFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_READ_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	try
+	{
+		tta_read_layout(hTempFile, &layout);
+		m_seek_table.insert(m_seek_table.end(), layout.seek_table.begin(), layout.seek_table.end());
+
+		TTAuint64 offset = layout.data_offset;
+		TTAuint64 remain = layout.data_length;
+		while (remain > 0)
+		{
+			dwBytesRead = static_cast<DWORD>(min(remain, static_cast<TTAuint64>(m_out_buffer.size())));
+			tta_read_file(hTempFile, offset, m_out_buffer.data(), dwBytesRead);
+			write(m_out_buffer.data(), dwBytesRead);
+			offset += dwBytesRead;
+			remain -= dwBytesRead;
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hTempFile);
+		throw;
+	}
+
+	CloseHandle(hTempFile);
+	DeleteFileW(m_szTempFileName);
+	m_szTempFileName[0] = L'\0';
+}
+
+void TTASpliceWriter::finish()
+{
+	if (m_coder != nullptr)
+	{
+		append_encoded();
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (m_samples != m_info.samples || m_seek_table.size() != tta_frame_count(m_info.samples, m_info.sps))
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	std::vector<TTAuint8> header(TTA_HEADER_SIZE + m_seek_table.size() * 4 + 4);
+	tta_write_header(header.data(), &m_info);
+	tta_write_seek_table(header.data() + TTA_HEADER_SIZE, m_seek_table.data(), m_seek_table.size());
+
+	LARGE_INTEGER pos;
+	pos.QuadPart = 0;
+	if (!SetFilePointerEx(m_hFile, pos, nullptr, FILE_BEGIN))
+	{
+		throw AudioCoderTTA_exception(TTA_SEEK_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+	write(header.data(), static_cast<DWORD>(header.size()));
+
+	if (!CloseHandle(m_hFile))
+	{
+		m_hFile = INVALID_HANDLE_VALUE;
+		DeleteFileW(m_filename.c_str());
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+	}
+	else
+	{
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+// Copies samples [start, start + length) of an opened TTA file to writer.
+// Whole frames are copied byte for byte while the output stays frame aligned,
+// everything else is decoded and handed to the encoder.
+static void splice(TTASpliceWriter *writer, HANDLE hFile, const tta_file_layout *layout, TTAuint32 start, TTAuint32 length)
+{
+	if (length == 0)
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	TTAuint32 flen_std = layout->flen_std;
+	TTAuint32 end = start + length;
+	size_t smp_size = static_cast<size_t>(layout->info.nch) * ((layout->info.bps + 7) / 8);
+	std::vector<TTAuint8> frame;
+	std::vector<TTAuint8> pcm;
+	TTAuint64 offset = tta_frame_offset(layout, start / flen_std);
+
+	for (TTAuint32 k = start / flen_std; k <= (end - 1) / flen_std; k++)
+	{
+		TTAuint32 frame_start = k * flen_std;
+		TTAuint32 frame_samples = min(flen_std, layout->info.samples - frame_start);
+		TTAuint32 from = (start > frame_start) ? start - frame_start : 0;
+		TTAuint32 to = min(end - frame_start, frame_samples);
+		TTAuint32 size = layout->seek_table[k];
+
+		frame.resize(size);
+		tta_read_file(hFile, offset, frame.data(), size);
+		offset += size;
+
+		if (from == 0 && to == frame_samples && writer->can_copy(frame_samples))
+		{
+			writer->copy_frame(frame.data(), size, frame_samples);
+		}
+		else
+		{
+			pcm.resize(frame_samples * smp_size);
+			int decoded = tta_decode_frame(&layout->info, k, frame.data(), size, pcm.data(), static_cast<TTAuint32>(pcm.size()));
+			if (decoded != static_cast<int>(frame_samples))
+			{
+				throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+			writer->encode(pcm.data() + from * smp_size, to - from);
+		}
+	}
+}
+
+static HANDLE open_source(const wchar_t *filename, tta_file_layout *layout)
+{
+	HANDLE hFile = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_OPEN_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	try
+	{
+		tta_read_layout(hFile, layout);
+		if (layout->info.format != TTA_FORMAT_SIMPLE)
+		{
+			throw AudioCoderTTA_exception(TTA_NOT_SUPPORTED);
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		throw;
+	}
+	return hFile;
+}
+
+void tta_cut(const wchar_t *src, const wchar_t *dst, TTAuint32 start, TTAuint32 length)
+{
+	tta_file_layout layout;
+	HANDLE hFile = open_source(src, &layout);
+
+	try
+	{
+		if (static_cast<TTAuint64>(start) + length > layout.info.samples)
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		TTA_info info = layout.info;
+		info.samples = length;
+
+		TTASpliceWriter writer(dst, &info);
+		splice(&writer, hFile, &layout, start, length);
+		writer.finish();
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		throw;
+	}
+	CloseHandle(hFile);
+}
+
+void tta_split(const wchar_t *src, const TTAuint32 *points, size_t count, const wchar_t *const *dst)
+{
+	tta_file_layout layout;
+	HANDLE hFile = open_source(src, &layout);
+
+	try
+	{
+		TTAuint32 start = 0;
+
+		for (size_t i = 0; i <= count; i++)
+		{
+			TTAuint32 end = (i < count) ? points[i] : layout.info.samples;
+			if (end < start || end > layout.info.samples)
+			{
+				throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			TTA_info info = layout.info;
+			info.samples = end - start;
+
+			TTASpliceWriter writer(dst[i], &info);
+			splice(&writer, hFile, &layout, start, end - start);
+			writer.finish();
+			start = end;
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		throw;
+	}
+	CloseHandle(hFile);
+}
+
+void tta_join(const wchar_t *const *src, size_t count, const wchar_t *dst)
+{
+	std::vector<tta_file_layout> layouts(count);
+	std::vector<HANDLE> files;
+	TTAuint64 samples = 0;
+
+	try
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			files.push_back(open_source(src[i], &layouts[i]));
+			if ((layouts[i].info.nch != layouts[0].info.nch) ||
+				(layouts[i].info.bps != layouts[0].info.bps) ||
+				(layouts[i].info.sps != layouts[0].info.sps))
+			{
+				throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+			samples += layouts[i].info.samples;
+		}
+
+		if (count == 0 || samples > MAX_SAMPLES)
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		TTA_info info = layouts[0].info;
+		info.samples = static_cast<TTAuint32>(samples);
+
+		TTASpliceWriter writer(dst, &info);
+		for (size_t i = 0; i < count; i++)
+		{
+			splice(&writer, files[i], &layouts[i], 0, layouts[i].info.samples);
+		}
+		writer.finish();
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		for (HANDLE hFile : files)
+		{
+			CloseHandle(hFile);
+		}
+		throw;
+	}
+
+	for (HANDLE hFile : files)
+	{
+		CloseHandle(hFile);
+	}
+}
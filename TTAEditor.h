@@ -0,0 +1,74 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TTAEDITOR_H_INCLUDED
+#define TTAEDITOR_H_INCLUDED
+
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <libtta.h>
+
+#include "TTAContainer.h"
+
+class AudioCoderTTA;
+
+/////////////////////// TTA frame splice writer ///////////////////////
+// Builds a TTA file from whole frames of other TTA files and from PCM.
+// Frames are copied as long as the output stays on a frame boundary;
+// from the first PCM block on, everything is encoded.
+class TTASpliceWriter
+{
+public:
+	TTASpliceWriter(const wchar_t *filename, const TTA_info *info);
+	virtual ~TTASpliceWriter();
+
+	bool aligned() const { return m_coder == nullptr && (m_samples % m_flen_std) == 0; }
+	bool can_copy(TTAuint32 samples) const;
+
+	void copy_frame(const TTAuint8 *frame, TTAuint32 size, TTAuint32 samples);
+	void encode(TTAuint8 *pcm, TTAuint32 samples);
+	void finish();
+
+private:
+	void write(const TTAuint8 *data, DWORD size);
+	void append_encoded();
+
+	TTA_info m_info = {};
+	TTAuint32 m_flen_std = 0;
+	TTAuint32 m_samples = 0;
+	std::vector<TTAuint32> m_seek_table;
+
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;
+	std::wstring m_filename;
+
+	std::unique_ptr<AudioCoderTTA> m_coder;
+	HANDLE m_hTempFile = INVALID_HANDLE_VALUE;
+	wchar_t m_szTempFileName[MAX_PATH] = {};
+	std::vector<TTAuint8> m_out_buffer;
+}; // class TTASpliceWriter
+
+//////////////////////// TTA editing functions ////////////////////////
+void tta_cut(const wchar_t *src, const wchar_t *dst, TTAuint32 start, TTAuint32 length);
+void tta_split(const wchar_t *src, const TTAuint32 *points, size_t count, const wchar_t *const *dst);
+void tta_join(const wchar_t *const *src, size_t count, const wchar_t *dst);
+
+#endif // #ifndef TTAEDITOR_H_INCLUDED
@@ -0,0 +1,279 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <string>
+
+#include "TraceRecorder.h"
+
+struct trace_event
+{
+	const char *name;
+	LONGLONG begin;
+	LONGLONG end;
+};
+
+struct trace_thread_buffer
+{
+	trace_thread_buffer *next = nullptr;
+	DWORD tid = 0;
+	std::atomic<size_t> head{ 0 };		// events recorded, advanced by the owning thread
+	std::atomic<size_t> tail{ 0 };		// events written out, advanced by Flush()
+	std::atomic<bool> exited{ false };
+	std::atomic<size_t> dropped{ 0 };		// events lost to a full buffer since the last flush
+	std::atomic<LONGLONG> dropped_at{ 0 };	// begin of the first of them
+	trace_event events[TRACE_EVENTS_PER_THREAD];
+};
+
+// Thread buffers are pushed onto this list by their threads. Flush() is the only
+// one to unlink them, and frees a buffer once its thread has exited and its
+// last events are written.
+static std::atomic<trace_thread_buffer*> trace_threads{ nullptr };
+
+struct trace_thread_owner
+{
+	trace_thread_buffer *buffer = nullptr;
+
+	~trace_thread_owner()
+	{
+		if (buffer != nullptr)
+		{
+			buffer->exited.store(true, std::memory_order_release);
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+};
+static thread_local trace_thread_owner trace_this_thread;
+
+static std::mutex trace_file_mutex;
+static std::wstring trace_filename;
+static bool trace_file_empty = true;
+
+static void flush_locked();
+
+void TraceRecorder::Start(const wchar_t *filename)
+{
+	std::lock_guard<std::mutex> lock(trace_file_mutex);
+	DWORD dwBytesWritten = 0;
+
+	// applied with every configuration, so only a new file name starts a new trace
+	if (trace_filename != filename)
+	{
+		trace_filename = filename;
+		trace_file_empty = true;
+
+		HANDLE hFile = trace_filename.empty() ? INVALID_HANDLE_VALUE :
+			CreateFileW(trace_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile != INVALID_HANDLE_VALUE)
+		{
+			WriteFile(hFile, "[\n", 2, &dwBytesWritten, nullptr);
+			CloseHandle(hFile);
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+	s_enabled.store(!trace_filename.empty(), std::memory_order_relaxed);
+}
+
+void TraceRecorder::Stop()
+{
+	Flush();
+	s_enabled.store(false, std::memory_order_relaxed);
+}
+
+LONGLONG TraceRecorder::Now()
+{
+	LARGE_INTEGER now;
+
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+void TraceRecorder::Record(const char *name, LONGLONG begin, LONGLONG end)
+{
+	trace_thread_buffer *buffer = trace_this_thread.buffer;
+
+	if (buffer == nullptr)
+	{
+		buffer = new (std::nothrow) trace_thread_buffer;
+		if (buffer == nullptr)
+		{
+			return;
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		buffer->tid = GetCurrentThreadId();
+		buffer->next = trace_threads.load(std::memory_order_relaxed);
+		while (!trace_threads.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+		{
+			// retry with the updated head
+		}
+		trace_this_thread.buffer = buffer;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	// only this thread writes to its buffer; the release store publishes the event to Flush()
+	size_t head = buffer->head.load(std::memory_order_relaxed);
+	size_t pending = head - buffer->tail.load(std::memory_order_acquire);
+	if (pending < TRACE_EVENTS_PER_THREAD)
+	{
+		trace_event &ev = buffer->events[head % TRACE_EVENTS_PER_THREAD];
+		ev.name = name;
+		ev.begin = begin;
+		ev.end = end;
+		buffer->head.store(head + 1, std::memory_order_release);
+		pending++;
+	}
+	else
+	{
+		if (buffer->dropped.load(std::memory_order_relaxed) == 0)
+		{
+			buffer->dropped_at.store(begin, std::memory_order_relaxed);
+		}
+		else
+		{
+			// Do nothing
+		}
+		buffer->dropped.fetch_add(1, std::memory_order_release);
+	}
+
+	// long encodes drain their own buffer, unless another thread is already writing the file
+	if (pending >= TRACE_EVENTS_PER_THREAD / 2)
+	{
+		std::unique_lock<std::mutex> lock(trace_file_mutex, std::try_to_lock);
+		if (lock.owns_lock())
+		{
+			flush_locked();
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void TraceRecorder::Flush()
+{
+	std::lock_guard<std::mutex> lock(trace_file_mutex);
+
+	flush_locked();
+}
+
+// called with trace_file_mutex held
+static void flush_locked()
+{
+	LARGE_INTEGER freq;
+	std::string json;
+	char line[256];
+	DWORD dwBytesWritten = 0;
+	DWORD pid = GetCurrentProcessId();
+
+	QueryPerformanceFrequency(&freq);
+	double us_per_tick = 1000000.0 / static_cast<double>(freq.QuadPart);
+
+	trace_thread_buffer *prev = nullptr;
+	trace_thread_buffer *buffer = trace_threads.load(std::memory_order_acquire);
+	while (buffer != nullptr)
+	{
+		// an exited thread records nothing more, so everything up to head is final
+		bool exited = buffer->exited.load(std::memory_order_acquire);
+		size_t head = buffer->head.load(std::memory_order_acquire);
+		for (size_t i = buffer->tail.load(std::memory_order_relaxed); i < head && !trace_filename.empty(); i++)
+		{
+			const trace_event &ev = buffer->events[i % TRACE_EVENTS_PER_THREAD];
+			_snprintf_s(line, sizeof(line), _TRUNCATE,
+				"%s{\"name\":\"%s\",\"cat\":\"enc_tta\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+				trace_file_empty ? "" : ",\n", ev.name, static_cast<double>(ev.begin) * us_per_tick,
+				static_cast<double>(ev.end - ev.begin) * us_per_tick, pid, buffer->tid);
+			json += line;
+			trace_file_empty = false;
+		}
+		buffer->tail.store(head, std::memory_order_release);
+
+		size_t dropped = buffer->dropped.exchange(0, std::memory_order_acquire);
+		if (dropped != 0 && !trace_filename.empty())
+		{
+			_snprintf_s(line, sizeof(line), _TRUNCATE,
+				"%s{\"name\":\"dropped\",\"cat\":\"enc_tta\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu,\"args\":{\"events\":%zu}}",
+				trace_file_empty ? "" : ",\n", static_cast<double>(buffer->dropped_at.load(std::memory_order_relaxed)) * us_per_tick,
+				pid, buffer->tid, dropped);
+			json += line;
+			trace_file_empty = false;
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		// the list head may be replaced by a new thread at any time, so it is left for a later flush
+		trace_thread_buffer *next = buffer->next;
+		if (exited && prev != nullptr)
+		{
+			prev->next = next;
+			delete buffer;
+		}
+		else
+		{
+			prev = buffer;
+		}
+		buffer = next;
+	}
+
+	if (json.empty())
+	{
+		return;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	HANDLE hFile = CreateFileW(trace_filename.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		WriteFile(hFile, json.data(), static_cast<DWORD>(json.size()), &dwBytesWritten, nullptr);
+		CloseHandle(hFile);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
@@ -0,0 +1,77 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACERECORDER_H_INCLUDED
+#define TRACERECORDER_H_INCLUDED
+
+#include <windows.h>
+#include <atomic>
+
+// events kept per thread between two flushes; a thread flushes by itself once half of
+// them are pending, and events arriving while the buffer is full are counted as dropped
+static const size_t TRACE_EVENTS_PER_THREAD = 65536;
+
+//////////////////// Chrome trace event recorder //////////////////////
+// Each thread records complete ("X") events into its own ring buffer
+// without taking a lock. Flush() drains the buffers and appends their
+// events to a Chrome trace file in the JSON array format, which needs no
+// closing bracket and can be loaded into Perfetto or chrome://tracing.
+// Dropped events show up as "dropped" instant events on their thread.
+class TraceRecorder
+{
+public:
+	static void Start(const wchar_t *filename);
+	static void Stop();
+	static void Flush();
+
+	static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+	static LONGLONG Now();
+	static void Record(const char *name, LONGLONG begin, LONGLONG end);
+
+private:
+	inline static std::atomic<bool> s_enabled{ false };
+}; // class TraceRecorder
+
+// records the time between construction and End() or destruction
+class TraceScope
+{
+public:
+	explicit TraceScope(const char *name) : m_name(name), m_begin(TraceRecorder::IsEnabled() ? TraceRecorder::Now() : 0) {}
+	~TraceScope() { End(); }
+
+	void End()
+	{
+		if (m_begin != 0)
+		{
+			TraceRecorder::Record(m_name, m_begin, TraceRecorder::Now());
+			m_begin = 0;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+
+private:
+	const char *m_name;	// must be a string literal
+	LONGLONG m_begin;
+}; // class TraceScope
+
+#endif // #ifndef TRACERECORDER_H_INCLUDED
@@ -0,0 +1,497 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <libtta.h>
+
+#include "AudioCoderTTA.h"
+#include "TTAContainer.h"
+#include "WaveFileReader.h"
+
+static const WORD WAVE_FORMAT_PCM_TAG = 0x0001;
+static const WORD WAVE_FORMAT_EXTENSIBLE_TAG = 0xFFFE;
+
+// Sony Wave64 chunk GUIDs as stored on disk
+static const TTAuint8 W64_GUID_RIFF[16] = { 0x72, 0x69, 0x66, 0x66, 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+static const TTAuint8 W64_GUID_WAVE[16] = { 0x77, 0x61, 0x76, 0x65, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+static const TTAuint8 W64_GUID_FMT[16] = { 0x66, 0x6D, 0x74, 0x20, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+static const TTAuint8 W64_GUID_DATA[16] = { 0x64, 0x61, 0x74, 0x61, 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+
+// KSDATAFORMAT_SUBTYPE_PCM without its leading format tag
+static const TTAuint8 SUBTYPE_GUID_TAIL[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
+typedef BOOL (WINAPI *PrefetchVirtualMemory_func)(HANDLE, ULONG_PTR, PWIN32_MEMORY_RANGE_ENTRY, ULONG);
+
+static __forceinline TTAuint32 get_uint16(const TTAuint8 *in)
+{
+	return static_cast<TTAuint32>(in[0]) | (static_cast<TTAuint32>(in[1]) << 8);
+}
+
+static __forceinline TTAuint32 get_uint32(const TTAuint8 *in)
+{
+	return static_cast<TTAuint32>(in[0]) | (static_cast<TTAuint32>(in[1]) << 8) |
+		(static_cast<TTAuint32>(in[2]) << 16) | (static_cast<TTAuint32>(in[3]) << 24);
+}
+
+static __forceinline TTAuint64 get_uint64(const TTAuint8 *in)
+{
+	return static_cast<TTAuint64>(get_uint32(in)) | (static_cast<TTAuint64>(get_uint32(in + 4)) << 32);
+}
+
+static PrefetchVirtualMemory_func get_prefetch_function()
+{
+	// PrefetchVirtualMemory is only available on Windows 8 and later
+	static const PrefetchVirtualMemory_func prefetch = reinterpret_cast<PrefetchVirtualMemory_func>(
+		GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+	return prefetch;
+}
+
+WaveFileReader::WaveFileReader()
+{
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+	m_granularity = si.dwAllocationGranularity;
+}
+
+WaveFileReader::~WaveFileReader()
+{
+	Close();
+}
+
+void WaveFileReader::Open(const wchar_t *filename)
+{
+	TTAuint8 id[16];
+	LARGE_INTEGER size;
+
+	Close();
+
+	m_hFile = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_OPEN_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	try
+	{
+		if (!GetFileSizeEx(m_hFile, &size))
+		{
+			throw AudioCoderTTA_exception(TTA_READ_ERROR);
+		}
+		else
+		{
+			m_file_size = static_cast<TTAuint64>(size.QuadPart);
+		}
+
+		tta_read_file(m_hFile, 0, id, 16);
+		if (memcmp(id, "RIFF", 4) == 0 && memcmp(id + 8, "WAVE", 4) == 0)
+		{
+			parse_riff(false);
+		}
+		else if ((memcmp(id, "RF64", 4) == 0 || memcmp(id, "BW64", 4) == 0) && memcmp(id + 8, "WAVE", 4) == 0)
+		{
+			parse_riff(true);
+		}
+		else if (memcmp(id, W64_GUID_RIFF, 16) == 0)
+		{
+			parse_wave64();
+		}
+		else
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+
+		// recordings that were not closed properly may claim more data than there is
+		if (m_data_offset > m_file_size)
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+		else if (m_data_length > m_file_size - m_data_offset)
+		{
+			m_data_length = m_file_size - m_data_offset;
+		}
+		else
+		{
+			// Do nothing
+		}
+		m_data_length -= m_data_length % m_block_align;
+
+		if (m_data_length > 0)
+		{
+			m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (m_hMapping == nullptr)
+			{
+				throw AudioCoderTTA_exception(TTA_MEMORY_ERROR);
+			}
+			else
+			{
+				// Do nothing
+			}
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		Close();
+		throw;
+	}
+}
+
+void WaveFileReader::Close()
+{
+	unmap_window(0);
+	unmap_window(1);
+
+	if (m_hMapping != nullptr)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	m_file_size = 0;
+	m_nch = 0;
+	m_srate = 0;
+	m_bps = 0;
+	m_block_align = 0;
+	m_data_offset = 0;
+	m_data_length = 0;
+	m_current_pos = 0;
+}
+
+void WaveFileReader::parse_riff(bool rf64)
+{
+	TTAuint8 chunk[8];
+	TTAuint8 ds64[24];
+	TTAuint64 ds64_data_size = 0;
+	TTAuint64 pos = 12;
+
+	while (pos + 8 <= m_file_size)
+	{
+		tta_read_file(m_hFile, pos, chunk, 8);
+		TTAuint64 size = get_uint32(chunk + 4);
+
+		if (memcmp(chunk, "ds64", 4) == 0 && size >= 24)
+		{
+			tta_read_file(m_hFile, pos + 8, ds64, 24);
+			ds64_data_size = get_uint64(ds64 + 8);
+		}
+		else if (memcmp(chunk, "fmt ", 4) == 0)
+		{
+			parse_fmt(pos + 8, size);
+		}
+		else if (memcmp(chunk, "data", 4) == 0)
+		{
+			m_data_offset = pos + 8;
+			if (rf64 && size == 0xFFFFFFFF)
+			{
+				m_data_length = ds64_data_size;
+			}
+			else if (size == 0 || size == 0xFFFFFFFF)
+			{
+				m_data_length = m_file_size - m_data_offset; // size never written by the recorder
+			}
+			else
+			{
+				m_data_length = size;
+			}
+			break;
+		}
+		else
+		{
+			// Do nothing
+		}
+		pos += 8 + size + (size & 1);
+	}
+
+	if (m_data_offset == 0 || m_block_align == 0)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void WaveFileReader::parse_wave64()
+{
+	TTAuint8 chunk[24];
+	TTAuint64 pos = 40;
+
+	if (m_file_size < pos)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		tta_read_file(m_hFile, 24, chunk, 16);
+	}
+
+	if (memcmp(chunk, W64_GUID_WAVE, 16) != 0)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	while (pos + 24 <= m_file_size)
+	{
+		tta_read_file(m_hFile, pos, chunk, 24);
+		TTAuint64 size = get_uint64(chunk + 16); // including the 24 byte chunk header
+
+		if (size < 24)
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+		else if (memcmp(chunk, W64_GUID_FMT, 16) == 0)
+		{
+			parse_fmt(pos + 24, size - 24);
+		}
+		else if (memcmp(chunk, W64_GUID_DATA, 16) == 0)
+		{
+			m_data_offset = pos + 24;
+			m_data_length = size - 24;
+			break;
+		}
+		else
+		{
+			// Do nothing
+		}
+		pos += (size + 7) & ~static_cast<TTAuint64>(7);
+	}
+
+	if (m_data_offset == 0 || m_block_align == 0)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void WaveFileReader::parse_fmt(TTAuint64 offset, TTAuint64 size)
+{
+	TTAuint8 fmt[40] = {};
+
+	if (size < 16)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		tta_read_file(m_hFile, offset, fmt, static_cast<DWORD>(min(size, static_cast<TTAuint64>(sizeof(fmt)))));
+	}
+
+	TTAuint32 tag = get_uint16(fmt);
+	TTAuint32 nch = get_uint16(fmt + 2);
+	TTAuint32 srate = get_uint32(fmt + 4);
+	TTAuint32 block_align = get_uint16(fmt + 12);
+	TTAuint32 bps = get_uint16(fmt + 14);
+
+	if (tag == WAVE_FORMAT_EXTENSIBLE_TAG)
+	{
+		if (size < sizeof(fmt) || memcmp(fmt + 26, SUBTYPE_GUID_TAIL, sizeof(SUBTYPE_GUID_TAIL)) != 0)
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+		else
+		{
+			tag = get_uint16(fmt + 24);
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (tag != WAVE_FORMAT_PCM_TAG)
+	{
+		throw AudioCoderTTA_exception(TTA_NOT_SUPPORTED);
+	}
+	else if ((nch == 0) ||
+		(nch > MAX_NCH) ||
+		(bps == 0) ||
+		(bps > MAX_BPS) ||
+		(srate == 0) ||
+		(block_align != nch * ((bps + 7) / 8)))
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	m_nch = static_cast<int>(nch);
+	m_srate = static_cast<int>(srate);
+	m_bps = static_cast<int>(bps);
+	m_block_align = static_cast<int>(block_align);
+}
+
+void WaveFileReader::map_window(int index, TTAuint64 offset)
+{
+	TTAuint64 aligned = offset - offset % m_granularity;
+	TTAuint64 length = min(WAVE_MAP_WINDOW_SIZE, m_data_offset + m_data_length - aligned);
+
+	m_view[index] = static_cast<TTAuint8*>(MapViewOfFile(m_hMapping, FILE_MAP_READ,
+		static_cast<DWORD>(aligned >> 32), static_cast<DWORD>(aligned), static_cast<SIZE_T>(length)));
+	if (m_view[index] == nullptr)
+	{
+		throw AudioCoderTTA_exception(TTA_MEMORY_ERROR);
+	}
+	else
+	{
+		m_view_offset[index] = aligned;
+		m_view_length[index] = length;
+	}
+
+	// ask the memory manager to read the window ahead of use
+	PrefetchVirtualMemory_func prefetch = get_prefetch_function();
+	if (prefetch != nullptr)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = m_view[index];
+		range.NumberOfBytes = static_cast<SIZE_T>(length);
+		prefetch(GetCurrentProcess(), 1, &range, 0);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+void WaveFileReader::unmap_window(int index)
+{
+	if (m_view[index] != nullptr)
+	{
+		UnmapViewOfFile(m_view[index]);
+		m_view[index] = nullptr;
+	}
+	else
+	{
+		// Do nothing
+	}
+	m_view_offset[index] = 0;
+	m_view_length[index] = 0;
+}
+
+const TTAuint8 *WaveFileReader::NextBlock(size_t *length)
+{
+	*length = 0;
+
+	if (m_current_pos >= m_data_length)
+	{
+		return nullptr;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	TTAuint64 file_pos = m_data_offset + m_current_pos;
+	TTAuint64 data_end = m_data_offset + m_data_length;
+
+	if (m_view[0] == nullptr || file_pos + m_block_align > m_view_offset[0] + m_view_length[0])
+	{
+		unmap_window(0);
+		if (m_view[1] != nullptr && file_pos >= m_view_offset[1] && file_pos + m_block_align <= m_view_offset[1] + m_view_length[1])
+		{
+			m_view[0] = m_view[1];
+			m_view_offset[0] = m_view_offset[1];
+			m_view_length[0] = m_view_length[1];
+			m_view[1] = nullptr;
+			m_view_offset[1] = 0;
+			m_view_length[1] = 0;
+		}
+		else
+		{
+			unmap_window(1);
+			map_window(0, file_pos);
+		}
+
+		// map the following window now so that its pages are read while this one is encoded
+		TTAuint64 view_end = m_view_offset[0] + m_view_length[0];
+		TTAuint64 next_pos = m_data_offset + ((view_end - m_data_offset) / m_block_align) * m_block_align;
+		if (next_pos < data_end)
+		{
+			map_window(1, next_pos);
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	TTAuint64 view_end = m_view_offset[0] + m_view_length[0];
+	TTAuint64 end = min(view_end, data_end);
+	TTAuint64 usable = ((end - file_pos) / m_block_align) * m_block_align;
+	const TTAuint8 *block = m_view[0] + (file_pos - m_view_offset[0]);
+
+	// keep WAVE_READ_PADDING bytes of the view behind the span, or copy the rest
+	if (file_pos + usable + WAVE_READ_PADDING > view_end)
+	{
+		TTAuint64 safe = (view_end - WAVE_READ_PADDING > file_pos) ? ((view_end - WAVE_READ_PADDING - file_pos) / m_block_align) * m_block_align : 0;
+		if (safe > 0)
+		{
+			usable = safe;
+		}
+		else
+		{
+			m_tail.assign(static_cast<size_t>(usable + WAVE_READ_PADDING), 0);
+			memcpy(m_tail.data(), block, static_cast<size_t>(usable));
+			block = m_tail.data();
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	*length = static_cast<size_t>(usable);
+	m_current_pos += usable;
+	return block;
+}
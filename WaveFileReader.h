@@ -0,0 +1,87 @@
+/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef WAVEFILEREADER_H_INCLUDED
+#define WAVEFILEREADER_H_INCLUDED
+
+#include <windows.h>
+#include <vector>
+#include <libtta.h>
+
+// size of one mapped window of the data chunk (multiple of the allocation granularity)
+static const TTAuint64 WAVE_MAP_WINDOW_SIZE = 32 * 1024 * 1024;
+
+// libtta's READ_BUFFER loads a 32-bit word per sample, up to this far past the last one
+static const TTAuint64 WAVE_READ_PADDING = 4;
+
+/////////////////// Memory mapped PCM wave reader /////////////////////
+// Reads RIFF WAVE (PCM and WAVE_FORMAT_EXTENSIBLE), RF64/BW64 and Sony Wave64.
+// The data chunk is mapped window by window; NextBlock() returns spans that
+// point straight into the mapping and always end on a sample boundary.
+// The last samples before the end of a window are returned from a padded
+// copy instead, so that reads past a span never leave the mapping.
+class WaveFileReader
+{
+public:
+	WaveFileReader();
+	virtual ~WaveFileReader();
+
+	void Open(const wchar_t *filename);
+	void Close();
+
+	int GetNumChannels() const { return m_nch; }
+	int GetSampleRate() const { return m_srate; }
+	int GetBitsPerSample() const { return m_bps; }
+	int GetBlockAlign() const { return m_block_align; }
+	TTAuint64 GetDataLength() const { return m_data_length; }
+	TTAuint64 GetSampleCount() const { return m_data_length / m_block_align; }
+
+	const TTAuint8 *NextBlock(size_t *length);
+
+private:
+	void parse_riff(bool rf64);
+	void parse_wave64();
+	void parse_fmt(TTAuint64 offset, TTAuint64 size);
+	void map_window(int index, TTAuint64 offset);
+	void unmap_window(int index);
+
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;
+	HANDLE m_hMapping = nullptr;
+	TTAuint64 m_file_size = 0;
+	DWORD m_granularity = 0;
+
+	int m_nch = 0;
+	int m_srate = 0;
+	int m_bps = 0;
+	int m_block_align = 0;
+
+	TTAuint64 m_data_offset = 0;
+	TTAuint64 m_data_length = 0;
+	TTAuint64 m_current_pos = 0;	// relative to m_data_offset
+
+	// current and read-ahead window
+	TTAuint8 *m_view[2] = { nullptr, nullptr };
+	TTAuint64 m_view_offset[2] = { 0, 0 };
+	TTAuint64 m_view_length[2] = { 0, 0 };
+
+	std::vector<TTAuint8> m_tail;
+}; // class WaveFileReader
+
+#endif // #ifndef WAVEFILEREADER_H_INCLUDED
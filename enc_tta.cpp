@@ -22,6 +22,7 @@ If not, see <https://www.gnu.org/licenses/>.
 
 #include "AudioCoderTTA.h"
 #include "enc_tta.h"
+#include "TraceRecorder.h"
 #include "VersionNo.h"
 
 #include <libtta.h>
@@ -34,6 +35,11 @@ If not, see <https://www.gnu.org/licenses/>.
 #include <Wasabi/bfc/platform/platform.h>
 
 #include <strsafe.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 HWND winampwnd = 0;
 api_service *WASABI_API_SVC = nullptr;
@@ -41,6 +47,13 @@ api_language *WASABI_API_LNG = nullptr;
 HINSTANCE WASABI_API_LNG_HINST = 0, WASABI_API_ORIG_HINST = 0;
 
 const static int MAX_MESSAGE_LENGTH = 1024;
+const static char CONFIG_SECTION[] = "audio_tta";
+
+// Tag items set through SetConfigItem(), kept per configuration file. Each transcode
+// session has a configuration file of its own, and the coder created for it takes
+// the items over in CreateAudio3(), so tags never move to another encode.
+static std::mutex pending_tags_lock;
+static std::map<std::string, std::vector<std::pair<std::string, std::string>>> pending_tags;
 
 typedef struct
 {
@@ -49,6 +62,103 @@ typedef struct
 }
 configwndrec;
 
+static void readconfig(const char *configfile, configtype *cfg)
+{
+	cfg->trace_file[0] = '\0';
+	cfg->cpu_share = 100;
+	cfg->io_limit = 0;
+	cfg->call_record_file[0] = '\0';
+	cfg->cache_dir[0] = '\0';
+	cfg->cache_limit = 1024;
+	cfg->numa = 0;
+	cfg->large_pages = 0;
+
+	if (configfile != nullptr)
+	{
+		GetPrivateProfileStringA(CONFIG_SECTION, "trace_file", "", cfg->trace_file, MAX_PATH, configfile);
+		cfg->cpu_share = static_cast<int>(GetPrivateProfileIntA(CONFIG_SECTION, "cpu_share", 100, configfile));
+		cfg->io_limit = static_cast<int>(GetPrivateProfileIntA(CONFIG_SECTION, "io_limit", 0, configfile));
+		GetPrivateProfileStringA(CONFIG_SECTION, "call_record_file", "", cfg->call_record_file, MAX_PATH, configfile);
+		GetPrivateProfileStringA(CONFIG_SECTION, "cache_dir", "", cfg->cache_dir, MAX_PATH, configfile);
+		cfg->cache_limit = static_cast<int>(GetPrivateProfileIntA(CONFIG_SECTION, "cache_limit", 1024, configfile));
+		cfg->numa = static_cast<int>(GetPrivateProfileIntA(CONFIG_SECTION, "numa", 0, configfile));
+		cfg->large_pages = static_cast<int>(GetPrivateProfileIntA(CONFIG_SECTION, "large_pages", 0, configfile));
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+static void writeconfig(const char *configfile, const configtype *cfg)
+{
+	if (configfile != nullptr)
+	{
+		char value[16];
+
+		WritePrivateProfileStringA(CONFIG_SECTION, "trace_file", cfg->trace_file, configfile);
+		StringCchPrintfA(value, 16, "%d", cfg->cpu_share);
+		WritePrivateProfileStringA(CONFIG_SECTION, "cpu_share", value, configfile);
+		StringCchPrintfA(value, 16, "%d", cfg->io_limit);
+		WritePrivateProfileStringA(CONFIG_SECTION, "io_limit", value, configfile);
+		WritePrivateProfileStringA(CONFIG_SECTION, "call_record_file", cfg->call_record_file, configfile);
+		WritePrivateProfileStringA(CONFIG_SECTION, "cache_dir", cfg->cache_dir, configfile);
+		StringCchPrintfA(value, 16, "%d", cfg->cache_limit);
+		WritePrivateProfileStringA(CONFIG_SECTION, "cache_limit", value, configfile);
+		WritePrivateProfileStringA(CONFIG_SECTION, "numa", cfg->numa ? "1" : "0", configfile);
+		WritePrivateProfileStringA(CONFIG_SECTION, "large_pages", cfg->large_pages ? "1" : "0", configfile);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
+static void applyconfig(const configtype *cfg)
+{
+	wchar_t trace_file[MAX_PATH];
+
+	if (MultiByteToWideChar(CP_ACP, 0, cfg->trace_file, -1, trace_file, MAX_PATH) == 0)
+	{
+		trace_file[0] = L'\0';
+	}
+	else
+	{
+		// Do nothing
+	}
+	TraceRecorder::Start(trace_file);
+
+	BufferAllocator::SetPolicy((cfg->numa ? BUFFER_POLICY_NUMA : BUFFER_POLICY_DEFAULT) |
+		(cfg->large_pages ? BUFFER_POLICY_LARGE_PAGES : BUFFER_POLICY_DEFAULT));
+}
+
+static std::string tag_session(const char *configfile)
+{
+	std::string session(configfile != nullptr ? configfile : "");
+
+	CharLowerBuffA(&session[0], static_cast<DWORD>(session.size()));
+	return session;
+}
+
+static void applytags(AudioCoderTTA *coder, const char *configfile)
+{
+	std::lock_guard<std::mutex> lock(pending_tags_lock);
+	auto session = pending_tags.find(tag_session(configfile));
+
+	if (session != pending_tags.end())
+	{
+		for (const auto &item : session->second)
+		{
+			coder->SetConfigItem(item.first.c_str(), item.second.c_str());
+		}
+		pending_tags.erase(session);
+	}
+	else
+	{
+		// Do nothing
+	}
+}
+
 // {65c17c78-f2d6-43fa-857f-386734fa48e5}
 static const GUID EncTTALangGUID =
 { 0x65c17c78, 0xf2d6, 0x43fa, { 0x85, 0x7f, 0x38, 0x67, 0x34, 0xfa, 0x48, 0xe5 } };
@@ -133,13 +243,15 @@ extern "C"
 	{
 		if (srct == mmioFOURCC('P', 'C', 'M', ' ') && *outt == mmioFOURCC('T', 'T', 'A', ' '))
 		{
-			//			configtype cfg;
-			//			readconfig(configfile, &cfg);
+			configtype cfg;
+			readconfig(configfile, &cfg);
+			applyconfig(&cfg);
 			*outt = mmioFOURCC('T', 'T', 'A', ' ');
 			AudioCoderTTA *t = nullptr;
 			try
 			{
 				t = new AudioCoderTTA(nch, srate, bps);
+				t->SetResourceLimits(cfg.cpu_share, static_cast<ULONGLONG>(max(cfg.io_limit, 0)) * 1024);
 			}
 			catch (const tta::tta_exception& e)
 			{
@@ -147,6 +259,37 @@ extern "C"
 				return nullptr;
 			}
 
+			applytags(t, configfile);
+
+			wchar_t cache_dir[MAX_PATH];
+			if (cfg.cache_dir[0] != '\0' &&
+				MultiByteToWideChar(CP_ACP, 0, cfg.cache_dir, -1, cache_dir, MAX_PATH) != 0)
+			{
+				t->SetEncodeCache(cache_dir, static_cast<TTAuint64>(max(cfg.cache_limit, 0)) << 20);
+			}
+			else
+			{
+				// Do nothing
+			}
+
+			wchar_t call_record_file[MAX_PATH];
+			if (cfg.call_record_file[0] != '\0' &&
+				MultiByteToWideChar(CP_ACP, 0, cfg.call_record_file, -1, call_record_file, MAX_PATH) != 0)
+			{
+				try
+				{
+					t->StartCallRecording(call_record_file);
+				}
+				catch (const AudioCoderTTA_exception&)
+				{
+					// encode without recording
+				}
+			}
+			else
+			{
+				// Do nothing
+			}
+
 			return t;
 		}
 		else
@@ -159,11 +302,27 @@ extern "C"
 	void __declspec(dllexport) FinishAudio3(const char *filename, AudioCoder *coder)
 	{
 		((AudioCoderTTA*)coder)->FinishAudio(filename);
+		if (TraceRecorder::IsEnabled())
+		{
+			TraceRecorder::Flush();
+		}
+		else
+		{
+			// Do nothing
+		}
 	}
 
 	void __declspec(dllexport) FinishAudio3W(const wchar_t *filename, AudioCoder *coder)
 	{
 		((AudioCoderTTA*)coder)->FinishAudio(filename);
+		if (TraceRecorder::IsEnabled())
+		{
+			TraceRecorder::Flush();
+		}
+		else
+		{
+			// Do nothing
+		}
 	}
 
 	void __declspec(dllexport) PrepareToFinish(const char *filename, AudioCoder *coder)
@@ -224,7 +383,73 @@ extern "C"
 
 	int __declspec(dllexport) SetConfigItem(unsigned int outt, char *item, char *data, char *configfile)
 	{
-		// nothing yet
+		if (outt == mmioFOURCC('T', 'T', 'A', ' '))
+		{
+			configtype cfg;
+			readconfig(configfile, &cfg);
+			if (!_strnicmp(item, TAG_ITEM_PREFIX, TAG_ITEM_PREFIX_LENGTH) || !lstrcmpiA(item, "tag_clear"))
+			{
+				// replayed on the coder of this session by AudioCoderTTA::SetConfigItem()
+				if (!lstrcmpiA(item, "tag_clear"))
+				{
+					std::lock_guard<std::mutex> lock(pending_tags_lock);
+					pending_tags[tag_session(configfile)].clear();
+				}
+				else if (tta_tag_key_valid(item + TAG_ITEM_PREFIX_LENGTH))
+				{
+					std::lock_guard<std::mutex> lock(pending_tags_lock);
+					pending_tags[tag_session(configfile)].push_back({ item, (data != nullptr) ? data : "" });
+				}
+				else
+				{
+					return 0;
+				}
+				return 1;
+			}
+			else if (!lstrcmpiA(item, "trace_file"))
+			{
+				lstrcpynA(cfg.trace_file, data, MAX_PATH);
+			}
+			else if (!lstrcmpiA(item, "cpu_share"))
+			{
+				cfg.cpu_share = min(max(atoi(data), 1), 100);
+			}
+			else if (!lstrcmpiA(item, "io_limit"))
+			{
+				cfg.io_limit = max(atoi(data), 0);
+			}
+			else if (!lstrcmpiA(item, "call_record_file"))
+			{
+				lstrcpynA(cfg.call_record_file, data, MAX_PATH);
+			}
+			else if (!lstrcmpiA(item, "cache_dir"))
+			{
+				lstrcpynA(cfg.cache_dir, data, MAX_PATH);
+			}
+			else if (!lstrcmpiA(item, "cache_limit"))
+			{
+				cfg.cache_limit = max(atoi(data), 0);
+			}
+			else if (!lstrcmpiA(item, "numa"))
+			{
+				cfg.numa = (atoi(data) != 0) ? 1 : 0;
+			}
+			else if (!lstrcmpiA(item, "large_pages"))
+			{
+				cfg.large_pages = (atoi(data) != 0) ? 1 : 0;
+			}
+			else
+			{
+				return 0;
+			}
+			writeconfig(configfile, &cfg);
+			applyconfig(&cfg);
+			return 1;
+		}
+		else
+		{
+			// Do nothing
+		}
 		return 0;
 	}
 
@@ -232,8 +457,44 @@ extern "C"
 	{
 		if (outt == mmioFOURCC('T', 'T', 'A', ' '))
 		{
-			//			configtype cfg;
-			//			readconfig(configfile, &cfg);
+			configtype cfg;
+			readconfig(configfile, &cfg);
+			if (!lstrcmpiA(item, "trace_file"))
+			{
+				lstrcpynA(data, cfg.trace_file, len);
+			}
+			else if (!lstrcmpiA(item, "cpu_share"))
+			{
+				StringCchPrintfA(data, len, "%d", cfg.cpu_share);
+			}
+			else if (!lstrcmpiA(item, "io_limit"))
+			{
+				StringCchPrintfA(data, len, "%d", cfg.io_limit);
+			}
+			else if (!lstrcmpiA(item, "call_record_file"))
+			{
+				lstrcpynA(data, cfg.call_record_file, len);
+			}
+			else if (!lstrcmpiA(item, "cache_dir"))
+			{
+				lstrcpynA(data, cfg.cache_dir, len);
+			}
+			else if (!lstrcmpiA(item, "cache_limit"))
+			{
+				StringCchPrintfA(data, len, "%d", cfg.cache_limit);
+			}
+			else if (!lstrcmpiA(item, "numa"))
+			{
+				StringCchPrintfA(data, len, "%d", cfg.numa);
+			}
+			else if (!lstrcmpiA(item, "large_pages"))
+			{
+				StringCchPrintfA(data, len, "%d", cfg.large_pages);
+			}
+			else
+			{
+				// Do nothing
+			}
 			//			if (!lstrcmpi(item, "bitrate"))  lstrcpynA(data, "755", len); // FUCKO: this is ment to be an estimate for approximations of output filesize (used by ml_pmp). Improve this.
 			//			else if (!lstrcmpi(item, "extension")) lstrcpynA(data, "flac", len);
 			return 1;
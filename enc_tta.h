@@ -21,8 +21,22 @@ If not, see <https://www.gnu.org/licenses/>.
 #ifndef ENC_TTA_H_INCLUDED
 #define ENC_TTA_H_INCLUDED
 
+#include <windows.h>
 #include <nsv/enc_if.h>
 
 #include "resource.h"
 
+typedef struct
+{
+	char trace_file[MAX_PATH];	// Chrome trace JSON output, empty to disable tracing
+	int cpu_share;				// governed mode: percent of one CPU, 100 to run unpaced
+	int io_limit;				// governed mode: finalize I/O in KB/s, 0 for unlimited
+	char call_record_file[MAX_PATH];	// Encode() call pattern for "tta_tool replay", empty to disable
+	char cache_dir[MAX_PATH];	// encode cache directory, empty to disable
+	int cache_limit;			// encode cache size limit in MB
+	int numa;					// 1: encoder buffers on the NUMA node of the creating thread
+	int large_pages;			// 1: encoder buffers on large pages where the account may lock memory
+}
+configtype;
+
 #endif // #ifndef ENC_TTA_H_INCLUDED
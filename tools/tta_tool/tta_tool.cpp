@@ -0,0 +1,673 @@
+﻿/*
+The ttaplugins-winamp project.
+Copyright (C) 2005-2026 Yamagata Fumihiro
+
+This file is part of enc_tta.
+
+enc_tta is free software: you can redistribute it and/or
+modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation, either
+version 3 of the License, or any later version.
+
+enc_tta is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with enc_tta.
+If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+#include <libtta.h>
+
+#include "AudioCoderTTA.h"
+#include "EncodeCache.h"
+#include "EncodeCallRecorder.h"
+#include "TTAEditor.h"
+#include "WaveFileReader.h"
+
+static const int OUTPUT_BUFFER_SIZE = 65536;
+static const TTAuint64 CACHE_LIMIT = 1024ULL << 20;	// same default as the plugin's cache_limit
+
+static void usage()
+{
+	fwprintf(stderr,
+		L"usage: tta_tool encode [-cache <dir>] <src.wav> <dst.tta> [<reserve>]\n"
+		L"       tta_tool append <src.wav> <dst.tta> [<reserve>]\n"
+		L"       tta_tool memencode <src.wav> <dst.tta>\n"
+		L"       tta_tool cut <src.tta> <dst.tta> <start> <length>\n"
+		L"       tta_tool split <src.tta> <dst_prefix> <position> [<position> ...]\n"
+		L"       tta_tool join <dst.tta> <src.tta> <src.tta> [<src.tta> ...]\n"
+		L"       tta_tool replay [-fast] <calls.ttac> [<src.wav>]\n"
+		L"positions and lengths are given in samples\n"
+		L"reserve leaves room in the file for the seek table entries of that many appended frames\n"
+		L"-cache copies a file encoded from the same samples out of dir instead of encoding, and stores new files there\n"
+		L"replay keeps the recorded gaps between calls unless -fast is given\n");
+}
+
+static bool parse_samples(const wchar_t *str, TTAuint32 *value)
+{
+	wchar_t *end = nullptr;
+	unsigned long long v = wcstoull(str, &end, 10);
+
+	if (end == str || *end != L'\0' || v > MAX_SAMPLES)
+	{
+		return false;
+	}
+	else
+	{
+		*value = static_cast<TTAuint32>(v);
+	}
+	return true;
+}
+
+// feeds one span to the encoder and writes everything it returns
+static void encode_block(AudioCoderTTA *coder, const TTAuint8 *in, size_t length, HANDLE hFile, std::vector<TTAuint8> *out)
+{
+	TTAuint8 *pos = const_cast<TTAuint8*>(in);
+	int in_avail = static_cast<int>(length);
+	int in_used = 0;
+	DWORD dwBytesWritten = 0;
+
+	for (;;)
+	{
+		int out_used = coder->Encode(0, pos, in_avail, &in_used, out->data(), static_cast<int>(out->size()));
+		if (!WriteFile(hFile, out->data(), static_cast<DWORD>(out_used), &dwBytesWritten, nullptr))
+		{
+			throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		pos += in_used;
+		in_avail -= in_used;
+		if (out_used == 0 && in_avail == 0)
+		{
+			break;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+}
+
+// hashes the samples of a WAV file the way the coder hashes what Encode() receives
+static TTAuint64 hash_wave_file(const wchar_t *filename)
+{
+	WaveFileReader reader;
+	PcmHasher hasher;
+	const TTAuint8 *block = nullptr;
+	size_t length = 0;
+
+	reader.Open(filename);
+	while ((block = reader.NextBlock(&length)) != nullptr)
+	{
+		hasher.Update(block, length);
+	}
+	return hasher.Digest();
+}
+
+// encodes src.wav into a new file, or behind the frames of an existing one
+static int cmd_encode(int argc, wchar_t *argv[], bool append)
+{
+	const wchar_t *cache_dir = nullptr;
+	wchar_t dst[MAX_PATHLEN];
+	WaveFileReader reader;
+	std::vector<TTAuint8> out(OUTPUT_BUFFER_SIZE);
+	const TTAuint8 *block = nullptr;
+	size_t length = 0;
+	TTAuint8 dummy = 0;
+	TTAuint32 reserve = 0;
+
+	if (!append && argc > 3 && wcscmp(argv[2], L"-cache") == 0)
+	{
+		cache_dir = argv[3];
+		argc -= 2;
+		argv += 2;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if ((argc != 4 && argc != 5) || (argc == 5 && !parse_samples(argv[4], &reserve)))
+	{
+		usage();
+		return 1;
+	}
+	else if (GetFullPathNameW(argv[3], MAX_PATHLEN, dst, nullptr) == 0)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	reader.Open(argv[2]);
+	if (reader.GetSampleCount() > MAX_SAMPLES)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	AudioCoderTTA coder(reader.GetNumChannels(), reader.GetSampleRate(), reader.GetBitsPerSample());
+	coder.ReserveAppendFrames(reserve);
+	if (append)
+	{
+		coder.OpenForAppend(dst);
+	}
+	else if (cache_dir != nullptr)
+	{
+		// the samples are hashed up front, so a hit skips the encode entirely
+		coder.SetEncodeCache(cache_dir, CACHE_LIMIT);
+		if (coder.FetchCachedFile(hash_wave_file(argv[2]), reader.GetSampleCount(), dst))
+		{
+			return 0;
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	HANDLE hFile = CreateFileW(dst, GENERIC_WRITE, 0, nullptr, append ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	LARGE_INTEGER zero;
+
+	zero.QuadPart = 0;
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else if (!SetFilePointerEx(hFile, zero, nullptr, FILE_END))
+	{
+		CloseHandle(hFile);
+		throw AudioCoderTTA_exception(TTA_SEEK_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	try
+	{
+		while ((block = reader.NextBlock(&length)) != nullptr)
+		{
+			encode_block(&coder, block, length, hFile, &out);
+		}
+
+		coder.PrepareToFinish();
+		encode_block(&coder, &dummy, 0, hFile, &out);
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		throw;
+	}
+
+	if (!CloseHandle(hFile))
+	{
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	coder.FinishAudio(dst);
+	return 0;
+}
+
+// encodes src.wav into memory and writes the finalized file in one go
+static int cmd_memencode(int argc, wchar_t *argv[])
+{
+	const DWORD CHUNK_SIZE = 1 << 24;
+	WaveFileReader reader;
+	std::vector<TTAuint8> out;
+	const TTAuint8 *block = nullptr;
+	size_t length = 0;
+
+	if (argc != 4)
+	{
+		usage();
+		return 1;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	reader.Open(argv[2]);
+	if (reader.GetSampleCount() > MAX_SAMPLES)
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	AudioCoderTTA coder(reader.GetNumChannels(), reader.GetSampleRate(), reader.GetBitsPerSample());
+	while ((block = reader.NextBlock(&length)) != nullptr)
+	{
+		coder.EncodeToMemory(const_cast<TTAuint8*>(block), static_cast<int>(length), &out);
+	}
+	coder.PrepareToFinish();
+	coder.EncodeToMemory(nullptr, 0, &out);
+	coder.FinishAudio(&out);
+
+	HANDLE hFile = CreateFileW(argv[3], GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_WRITE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	try
+	{
+		for (size_t pos = 0; pos < out.size(); pos += CHUNK_SIZE)
+		{
+			tta_write_file(hFile, pos, out.data() + pos, static_cast<DWORD>(min(out.size() - pos, static_cast<size_t>(CHUNK_SIZE))));
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		throw;
+	}
+
+	if (!CloseHandle(hFile))
+	{
+		throw AudioCoderTTA_exception(TTA_FILE_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+	return 0;
+}
+
+static int cmd_cut(int argc, wchar_t *argv[])
+{
+	TTAuint32 start = 0;
+	TTAuint32 length = 0;
+
+	if (argc != 6 || !parse_samples(argv[4], &start) || !parse_samples(argv[5], &length))
+	{
+		usage();
+		return 1;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	tta_cut(argv[2], argv[3], start, length);
+	return 0;
+}
+
+static int cmd_split(int argc, wchar_t *argv[])
+{
+	std::vector<TTAuint32> points;
+	std::vector<std::wstring> names;
+	std::vector<const wchar_t*> dst;
+	wchar_t suffix[32];
+
+	if (argc < 5)
+	{
+		usage();
+		return 1;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	for (int i = 4; i < argc; i++)
+	{
+		TTAuint32 point = 0;
+		if (!parse_samples(argv[i], &point))
+		{
+			usage();
+			return 1;
+		}
+		else
+		{
+			points.push_back(point);
+		}
+	}
+
+	for (size_t i = 0; i <= points.size(); i++)
+	{
+		swprintf_s(suffix, 32, L"_%02u.tta", static_cast<unsigned int>(i + 1));
+		names.push_back(std::wstring(argv[3]) + suffix);
+	}
+	for (const std::wstring &name : names)
+	{
+		dst.push_back(name.c_str());
+	}
+
+	tta_split(argv[2], points.data(), points.size(), dst.data());
+	return 0;
+}
+
+static int cmd_join(int argc, wchar_t *argv[])
+{
+	if (argc < 5)
+	{
+		usage();
+		return 1;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	tta_join(argv + 3, static_cast<size_t>(argc - 3), argv[2]);
+	return 0;
+}
+
+// makes pcm[pos..pos+length) valid, from src or as white noise (worst case for the coder)
+static void replay_fill(WaveFileReader *src, std::vector<TTAuint8> *pcm, size_t *pos, size_t length, TTAuint32 *seed)
+{
+	if (*pos > pcm->size() / 2)
+	{
+		pcm->erase(pcm->begin(), pcm->begin() + *pos);
+		*pos = 0;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	while (pcm->size() - *pos < length)
+	{
+		size_t block_length = 0;
+		const TTAuint8 *block = (src != nullptr) ? src->NextBlock(&block_length) : nullptr;
+
+		if (block != nullptr)
+		{
+			pcm->insert(pcm->end(), block, block + block_length);
+		}
+		else
+		{
+			// source exhausted or none given
+			size_t missing = length - (pcm->size() - *pos);
+			for (size_t i = 0; i < missing; i++)
+			{
+				*seed = *seed * 1664525UL + 1013904223UL;
+				pcm->push_back(static_cast<TTAuint8>(*seed >> 24));
+			}
+		}
+	}
+}
+
+static double percentile(const std::vector<LONGLONG> &sorted, double p, double frequency)
+{
+	size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+	return static_cast<double>(sorted[index]) * 1000000.0 / frequency;
+}
+
+static void print_latencies(const wchar_t *label, std::vector<LONGLONG> *latencies, double frequency)
+{
+	std::sort(latencies->begin(), latencies->end());
+	wprintf(L"%-9ls p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f us\n", label,
+		percentile(*latencies, 0.5, frequency), percentile(*latencies, 0.9, frequency),
+		percentile(*latencies, 0.99, frequency), percentile(*latencies, 0.999, frequency),
+		percentile(*latencies, 1.0, frequency));
+}
+
+// waits until the replay clock reaches target, sleeping for the coarse part and spinning for the rest
+static void replay_wait(LONGLONG target, LONGLONG frequency)
+{
+	for (LONGLONG now = EncodeCallRecorder::Now(); now < target; now = EncodeCallRecorder::Now())
+	{
+		LONGLONG remaining_ms = (target - now) * 1000 / frequency;
+		if (remaining_ms > 2)
+		{
+			Sleep(static_cast<DWORD>(remaining_ms - 2));
+		}
+		else
+		{
+			YieldProcessor();
+		}
+	}
+}
+
+// Feeds a recorded Encode() call pattern to a fresh encoder and times every call.
+// Calls start at their recorded offsets, so the caches and clocks see the same idle
+// time between calls as during the recording; -fast issues them back to back.
+static int cmd_replay(int argc, wchar_t *argv[])
+{
+	encode_call_header header = {};
+	std::vector<encode_call_record> records;
+	LARGE_INTEGER file_size;
+	LARGE_INTEGER frequency;
+	bool fast = false;
+
+	if (argc >= 3 && wcscmp(argv[2], L"-fast") == 0)
+	{
+		fast = true;
+		argc--;
+		argv++;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	if (argc != 3 && argc != 4)
+	{
+		usage();
+		return 1;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	HANDLE hFile = CreateFileW(argv[2], GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		throw AudioCoderTTA_exception(TTA_OPEN_ERROR);
+	}
+	else if (!GetFileSizeEx(hFile, &file_size) || file_size.QuadPart < static_cast<LONGLONG>(sizeof(header)))
+	{
+		CloseHandle(hFile);
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	records.resize(static_cast<size_t>((file_size.QuadPart - sizeof(header)) / sizeof(encode_call_record)));
+	try
+	{
+		tta_read_file(hFile, 0, reinterpret_cast<TTAuint8*>(&header), sizeof(header));
+		if (!records.empty())
+		{
+			tta_read_file(hFile, sizeof(header), reinterpret_cast<TTAuint8*>(records.data()),
+				static_cast<DWORD>(records.size() * sizeof(encode_call_record)));
+		}
+		else
+		{
+			// Do nothing
+		}
+	}
+	catch (AudioCoderTTA_exception&)
+	{
+		CloseHandle(hFile);
+		throw;
+	}
+	CloseHandle(hFile);
+
+	if (memcmp(header.magic, ENCODE_CALL_MAGIC, 4) != 0 || header.version != ENCODE_CALL_VERSION ||
+		header.frequency == 0 || records.empty())
+	{
+		throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	WaveFileReader reader;
+	WaveFileReader *src = nullptr;
+	if (argc == 4)
+	{
+		reader.Open(argv[3]);
+		if (static_cast<TTAuint32>(reader.GetNumChannels()) != header.nch ||
+			static_cast<TTAuint32>(reader.GetSampleRate()) != header.sps ||
+			static_cast<TTAuint32>(reader.GetBitsPerSample()) != header.bps)
+		{
+			throw AudioCoderTTA_exception(TTA_FORMAT_ERROR);
+		}
+		else
+		{
+			src = &reader;
+		}
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	AudioCoderTTA coder(static_cast<int>(header.nch), static_cast<int>(header.sps), static_cast<int>(header.bps));
+	std::vector<TTAuint8> pcm;
+	std::vector<TTAuint8> out;
+	std::vector<LONGLONG> replayed;
+	std::vector<LONGLONG> recorded;
+	size_t pos = 0;
+	TTAuint32 seed = 1;
+	TTAuint64 in_total = 0;
+	TTAuint64 out_total = 0;
+	LONGLONG elapsed = 0;
+
+	QueryPerformanceFrequency(&frequency);
+	replayed.reserve(records.size());
+	recorded.reserve(records.size());
+
+	double ticks_per_recorded_tick = static_cast<double>(frequency.QuadPart) / static_cast<double>(header.frequency);
+	LONGLONG start = EncodeCallRecorder::Now();
+
+	for (const encode_call_record &record : records)
+	{
+		int in_used = 0;
+
+		if (record.flags & ENCODE_CALL_FLAG_LAST)
+		{
+			coder.PrepareToFinish();
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		replay_fill(src, &pcm, &pos, static_cast<size_t>(max(record.in_avail, 0)) + 1, &seed);
+		out.resize(static_cast<size_t>(max(record.out_avail, 1)));
+		if (!fast)
+		{
+			replay_wait(start + static_cast<LONGLONG>(static_cast<double>(record.begin) * ticks_per_recorded_tick), frequency.QuadPart);
+		}
+		else
+		{
+			// Do nothing
+		}
+
+		LONGLONG begin = EncodeCallRecorder::Now();
+		int out_used = coder.Encode(0, pcm.data() + pos, record.in_avail, &in_used, out.data(), record.out_avail);
+		LONGLONG duration = EncodeCallRecorder::Now() - begin;
+
+		pos += in_used;
+		in_total += in_used;
+		out_total += out_used;
+		elapsed += duration;
+		replayed.push_back(duration);
+		recorded.push_back(record.duration);
+	}
+
+	double seconds = static_cast<double>(elapsed) / static_cast<double>(frequency.QuadPart);
+	double audio_seconds = static_cast<double>(in_total) / (header.nch * ((header.bps + 7) / 8)) / header.sps;
+	wprintf(L"calls     %zu\n", records.size());
+	wprintf(L"input     %llu bytes, output %llu bytes\n", in_total, out_total);
+	wprintf(L"time      %.3f s in Encode(), %.1f MB/s, %.1fx realtime\n", seconds,
+		(seconds > 0.0) ? in_total / seconds / 1000000.0 : 0.0, (seconds > 0.0) ? audio_seconds / seconds : 0.0);
+	print_latencies(L"replayed", &replayed, static_cast<double>(frequency.QuadPart));
+	print_latencies(L"recorded", &recorded, static_cast<double>(header.frequency));
+	return 0;
+}
+
+int wmain(int argc, wchar_t *argv[])
+{
+	if (argc < 2)
+	{
+		usage();
+		return 1;
+	}
+	else
+	{
+		// Do nothing
+	}
+
+	try
+	{
+		if (wcscmp(argv[1], L"encode") == 0)
+		{
+			return cmd_encode(argc, argv, false);
+		}
+		else if (wcscmp(argv[1], L"append") == 0)
+		{
+			return cmd_encode(argc, argv, true);
+		}
+		else if (wcscmp(argv[1], L"memencode") == 0)
+		{
+			return cmd_memencode(argc, argv);
+		}
+		else if (wcscmp(argv[1], L"cut") == 0)
+		{
+			return cmd_cut(argc, argv);
+		}
+		else if (wcscmp(argv[1], L"split") == 0)
+		{
+			return cmd_split(argc, argv);
+		}
+		else if (wcscmp(argv[1], L"join") == 0)
+		{
+			return cmd_join(argc, argv);
+		}
+		else if (wcscmp(argv[1], L"replay") == 0)
+		{
+			return cmd_replay(argc, argv);
+		}
+		else
+		{
+			usage();
+		}
+	}
+	catch (AudioCoderTTA_exception &ex)
+	{
+		fwprintf(stderr, L"tta_tool: %ls failed (tta_error %d)\n", argv[1], static_cast<int>(ex.code()));
+		return 2;
+	}
+	return 1;
+}